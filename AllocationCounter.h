@@ -0,0 +1,11 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+#include <cstdint>
+
+
+// Linking AllocationCounter.cpp into an executable replaces the global operator new and delete with versions that
+// count every allocation. Used by the benchmark and replay tools to verify that the book does not allocate once
+// it is warmed up. Never link it into the library itself
+std::uint64_t allocationCount();
+
+#endif
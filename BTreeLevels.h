@@ -0,0 +1,416 @@
+#ifndef BTREE_LEVELS_H
+#define BTREE_LEVELS_H
+#include "OrderBookConfig.h"
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+
+// Level policy (see MapLevels.h) for deep books. A B+tree with 16 keys per node, so a lookup over thousands of levels
+// touches three or four nodes instead of a dozen map nodes spread over the heap. Prices are stored as signed keys
+// that ascend from the best price, which lets a node be searched with 64 bit SIMD compares (AVX2, SSE4.2 or a scalar
+// loop, whatever the build targets) and makes the leftmost leaf, which the tree keeps a pointer to, hold the best
+// level. The levels live in a separate array indexed from the leaves, so the nodes stay small and splits move slot
+// indexes rather than levels. The array itself moves its levels when it grows past what reserve made room for, so a
+// reference to a level only lasts until the next one is created.
+//
+// Nodes are recycled through a free list of the tree's own, a leaf is removed once its last level is erased and an
+// inner node once its last child is. Nodes are not merged while they still hold keys, the tree only ever grows in
+// height through splits
+template<typename Compare, typename Level>
+class BTreeLevels {
+public:
+    static constexpr bool highestFirst = std::is_same_v<Compare, std::greater<Price> >;
+
+    BTreeLevels(const OrderBookConfig &, std::pmr::memory_resource *resource)
+        : resource(resource), values(resource), freeSlots(resource) {
+    }
+
+    ~BTreeLevels() {
+        destroy(root);
+        while (freeNodes != nullptr) {
+            Node *next = freeNodes->children[0];
+            resource->deallocate(freeNodes, sizeof(Node), alignof(Node));
+            freeNodes = next;
+        }
+    }
+
+    BTreeLevels(const BTreeLevels &) = delete;
+    BTreeLevels &operator=(const BTreeLevels &) = delete;
+
+    // Creates the queues and nodes for this many levels, enough for a tree whose leaves are half full
+    void reserve(const std::size_t levels) {
+        values.reserve(levels);
+        freeSlots.reserve(levels);
+        const std::size_t leaves = levels / (nodeKeys / 2) + 1;
+        for (std::size_t i = 0; i < 2 * leaves + maxHeight; ++i) {
+            releaseNode(new(resource->allocate(sizeof(Node), alignof(Node))) Node());
+        }
+    }
+
+    static bool better(const Price price, const Price other) { return Compare()(price, other); }
+
+    bool empty() const { return first == nullptr; }
+
+    Price bestPrice() const { return toPrice(first->keys[0]); }
+
+    Level &bestQueue() { return values[first->leaf.slots[0]]; }
+
+    void eraseBest() {
+        if (first->count > 1) {
+            // Separators above stay valid when the smallest key of a leaf goes, no need to walk down
+            removeFromLeaf(first, 0);
+        } else {
+            erase(bestPrice());
+        }
+    }
+
+    // Level at price, an empty one is created if it does not exist yet
+    Level &operator[](const Price price) {
+        const std::int64_t key = toKey(price);
+        if (root == nullptr) {
+            root = first = allocateNode(true);
+        }
+
+        Path path;
+        Node *leaf = descend(key, path);
+        const std::size_t position = lowerBound(leaf, key);
+        if (position < leaf->count && leaf->keys[position] == key) {
+            return values[leaf->leaf.slots[position]];
+        }
+
+        const std::uint32_t slot = acquireSlot();
+        if (leaf->count < nodeKeys) {
+            insertIntoLeaf(leaf, position, key, slot);
+        } else {
+            Node *right = splitLeaf(leaf, path);
+            if (position <= nodeKeys / 2) {
+                insertIntoLeaf(leaf, position, key, slot);
+            } else {
+                insertIntoLeaf(right, position - nodeKeys / 2, key, slot);
+            }
+        }
+        return values[slot];
+    }
+
+    Level *find(const Price price) {
+        if (root == nullptr) return nullptr;
+        const std::int64_t key = toKey(price);
+        Path path;
+        Node *leaf = descend(key, path);
+        const std::size_t position = lowerBound(leaf, key);
+        return position < leaf->count && leaf->keys[position] == key ? &values[leaf->leaf.slots[position]] : nullptr;
+    }
+
+    const Level *find(const Price price) const {
+        if (root == nullptr) return nullptr;
+        const std::int64_t key = toKey(price);
+        Path path;
+        Node *leaf = descend(key, path);
+        const std::size_t position = lowerBound(leaf, key);
+        return position < leaf->count && leaf->keys[position] == key ? &values[leaf->leaf.slots[position]] : nullptr;
+    }
+
+    void erase(const Price price) {
+        const std::int64_t key = toKey(price);
+        Path path;
+        Node *leaf = descend(key, path);
+        removeFromLeaf(leaf, lowerBound(leaf, key));
+        if (leaf->count == 0) {
+            removeLeaf(leaf, path);
+        }
+    }
+
+    template<typename Visit>
+    void forEachLevel(Visit &&visit) const {
+        for (const Node *leaf = first; leaf != nullptr; leaf = leaf->leaf.next) {
+            for (std::size_t i = 0; i < leaf->count; ++i) {
+                if (!visit(toPrice(leaf->keys[i]), values[leaf->leaf.slots[i]])) return;
+            }
+        }
+    }
+
+private:
+    static constexpr std::size_t nodeKeys = 16;
+    // Only splits add a level and every split at least halves a full node, far more than a book can reach
+    static constexpr std::size_t maxHeight = 32;
+
+    // Keys take the first two cache lines so a search reads them with four AVX2 or eight SSE loads
+    struct alignas(64) Node {
+        std::int64_t keys[nodeKeys];
+        std::uint32_t count = 0;
+        bool isLeaf = false;
+        union {
+            // children[i] holds the keys in [keys[i - 1], keys[i])
+            Node *children[nodeKeys + 1];
+            struct {
+                std::uint32_t slots[nodeKeys];
+                Node *prev;
+                Node *next;
+            } leaf;
+        };
+    };
+
+    // Inner nodes visited on the way to a leaf and the child taken in each
+    struct Path {
+        Node *nodes[maxHeight];
+        std::uint32_t children[maxHeight];
+        std::size_t depth = 0;
+    };
+
+    static std::int64_t toKey(const Price price) {
+        const std::uint64_t ascending = highestFirst ? ~price : price;
+        return static_cast<std::int64_t>(ascending ^ std::uint64_t{1} << 63);
+    }
+
+    static Price toPrice(const std::int64_t key) {
+        const std::uint64_t ascending = static_cast<std::uint64_t>(key) ^ std::uint64_t{1} << 63;
+        return highestFirst ? ~ascending : ascending;
+    }
+
+    // Bit i is set when keys[i] > key, or keys[i] < key with Less
+    template<bool Less>
+    static std::uint32_t compareMask(const std::int64_t *keys, const std::int64_t key) {
+        std::uint32_t mask = 0;
+#if defined(__AVX2__)
+        const __m256i needle = _mm256_set1_epi64x(key);
+        for (std::size_t i = 0; i < nodeKeys; i += 4) {
+            const __m256i block = _mm256_load_si256(reinterpret_cast<const __m256i *>(keys + i));
+            const __m256i result = Less ? _mm256_cmpgt_epi64(needle, block) : _mm256_cmpgt_epi64(block, needle);
+            mask |= static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(result))) << i;
+        }
+#elif defined(__SSE4_2__)
+        const __m128i needle = _mm_set1_epi64x(key);
+        for (std::size_t i = 0; i < nodeKeys; i += 2) {
+            const __m128i block = _mm_load_si128(reinterpret_cast<const __m128i *>(keys + i));
+            const __m128i result = Less ? _mm_cmpgt_epi64(needle, block) : _mm_cmpgt_epi64(block, needle);
+            mask |= static_cast<std::uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(result))) << i;
+        }
+#else
+        for (std::size_t i = 0; i < nodeKeys; ++i) {
+            mask |= static_cast<std::uint32_t>(Less ? keys[i] < key : keys[i] > key) << i;
+        }
+#endif
+        return mask;
+    }
+
+    // Number of keys not greater than key, i.e. the child of an inner node that covers key. Keys beyond count are
+    // garbage and masked off
+    static std::size_t upperBound(const Node *node, const std::int64_t key) {
+        const std::uint32_t valid = (std::uint32_t{1} << node->count) - 1;
+        return node->count - std::popcount(compareMask<false>(node->keys, key) & valid);
+    }
+
+    // Number of keys smaller than key, i.e. where key is or would be in a leaf
+    static std::size_t lowerBound(const Node *node, const std::int64_t key) {
+        const std::uint32_t valid = (std::uint32_t{1} << node->count) - 1;
+        return std::popcount(compareMask<true>(node->keys, key) & valid);
+    }
+
+    Node *descend(const std::int64_t key, Path &path) const {
+        Node *node = root;
+        while (!node->isLeaf) {
+            const auto child = static_cast<std::uint32_t>(upperBound(node, key));
+            path.nodes[path.depth] = node;
+            path.children[path.depth++] = child;
+            node = node->children[child];
+        }
+        return node;
+    }
+
+    Node *allocateNode(const bool isLeaf) {
+        Node *node = freeNodes;
+        if (node != nullptr) {
+            freeNodes = node->children[0];
+        } else {
+            node = new(resource->allocate(sizeof(Node), alignof(Node))) Node();
+        }
+        node->count = 0;
+        node->isLeaf = isLeaf;
+        if (isLeaf) {
+            node->leaf.prev = nullptr;
+            node->leaf.next = nullptr;
+        }
+        return node;
+    }
+
+    void releaseNode(Node *node) {
+        node->children[0] = freeNodes;
+        freeNodes = node;
+    }
+
+    void destroy(Node *node) {
+        if (node == nullptr) return;
+        if (!node->isLeaf) {
+            for (std::size_t i = 0; i <= node->count; ++i) {
+                destroy(node->children[i]);
+            }
+        }
+        resource->deallocate(node, sizeof(Node), alignof(Node));
+    }
+
+    std::uint32_t acquireSlot() {
+        if (freeSlots.empty()) {
+            values.emplace_back();
+            return static_cast<std::uint32_t>(values.size() - 1);
+        }
+        const std::uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        values[slot] = Level();
+        return slot;
+    }
+
+    static void insertIntoLeaf(Node *leaf, const std::size_t position, const std::int64_t key,
+                               const std::uint32_t slot) {
+        for (std::size_t i = leaf->count; i > position; --i) {
+            leaf->keys[i] = leaf->keys[i - 1];
+            leaf->leaf.slots[i] = leaf->leaf.slots[i - 1];
+        }
+        leaf->keys[position] = key;
+        leaf->leaf.slots[position] = slot;
+        ++leaf->count;
+    }
+
+    void removeFromLeaf(Node *leaf, const std::size_t position) {
+        freeSlots.push_back(leaf->leaf.slots[position]);
+        for (std::size_t i = position + 1; i < leaf->count; ++i) {
+            leaf->keys[i - 1] = leaf->keys[i];
+            leaf->leaf.slots[i - 1] = leaf->leaf.slots[i];
+        }
+        --leaf->count;
+    }
+
+    // Moves the upper half of a full leaf into a new right sibling and returns it
+    Node *splitLeaf(Node *leaf, Path &path) {
+        Node *right = allocateNode(true);
+        for (std::size_t i = nodeKeys / 2; i < nodeKeys; ++i) {
+            right->keys[i - nodeKeys / 2] = leaf->keys[i];
+            right->leaf.slots[i - nodeKeys / 2] = leaf->leaf.slots[i];
+        }
+        right->count = nodeKeys / 2;
+        leaf->count = nodeKeys / 2;
+
+        right->leaf.prev = leaf;
+        right->leaf.next = leaf->leaf.next;
+        if (leaf->leaf.next != nullptr) leaf->leaf.next->leaf.prev = right;
+        leaf->leaf.next = right;
+
+        insertIntoParent(path, leaf, right->keys[0], right);
+        return right;
+    }
+
+    // Adds right, whose smallest key is separator, next to left in left's parent, splitting parents as needed
+    void insertIntoParent(Path &path, Node *left, const std::int64_t separator, Node *right) {
+        if (path.depth == 0) {
+            Node *newRoot = allocateNode(false);
+            newRoot->keys[0] = separator;
+            newRoot->children[0] = left;
+            newRoot->children[1] = right;
+            newRoot->count = 1;
+            root = newRoot;
+            return;
+        }
+
+        --path.depth;
+        Node *parent = path.nodes[path.depth];
+        const std::size_t index = path.children[path.depth];
+        if (parent->count < nodeKeys) {
+            for (std::size_t i = parent->count; i > index; --i) {
+                parent->keys[i] = parent->keys[i - 1];
+                parent->children[i + 1] = parent->children[i];
+            }
+            parent->keys[index] = separator;
+            parent->children[index + 1] = right;
+            ++parent->count;
+            return;
+        }
+
+        // Full parent: lay out all keys and children with the new one in place, keep the lower half, hand the
+        // upper half to a new sibling and push the middle key further up
+        std::int64_t keys[nodeKeys + 1];
+        Node *children[nodeKeys + 2];
+        for (std::size_t i = 0, from = 0; i <= nodeKeys; ++i) {
+            keys[i] = i == index ? separator : parent->keys[from++];
+        }
+        for (std::size_t i = 0, from = 0; i <= nodeKeys + 1; ++i) {
+            children[i] = i == index + 1 ? right : parent->children[from++];
+        }
+
+        constexpr std::size_t middle = nodeKeys / 2;
+        Node *sibling = allocateNode(false);
+        for (std::size_t i = 0; i < middle; ++i) {
+            parent->keys[i] = keys[i];
+        }
+        for (std::size_t i = 0; i <= middle; ++i) {
+            parent->children[i] = children[i];
+        }
+        parent->count = middle;
+        for (std::size_t i = middle + 1; i <= nodeKeys; ++i) {
+            sibling->keys[i - middle - 1] = keys[i];
+        }
+        for (std::size_t i = middle + 1; i <= nodeKeys + 1; ++i) {
+            sibling->children[i - middle - 1] = children[i];
+        }
+        sibling->count = nodeKeys - middle;
+
+        insertIntoParent(path, parent, keys[middle], sibling);
+    }
+
+    // Unlinks an empty leaf and removes inner nodes left without children on the way up
+    void removeLeaf(Node *leaf, Path &path) {
+        if (leaf->leaf.prev != nullptr) leaf->leaf.prev->leaf.next = leaf->leaf.next;
+        if (leaf->leaf.next != nullptr) leaf->leaf.next->leaf.prev = leaf->leaf.prev;
+        if (first == leaf) first = leaf->leaf.next;
+        releaseNode(leaf);
+
+        while (path.depth > 0) {
+            --path.depth;
+            Node *parent = path.nodes[path.depth];
+            const std::size_t index = path.children[path.depth];
+            if (parent->count == 0) {
+                // That was its only child
+                releaseNode(parent);
+                continue;
+            }
+
+            // Dropping child 0 drops the separator to its right, any other child the separator to its left
+            const std::size_t key = index == 0 ? 0 : index - 1;
+            for (std::size_t i = key + 1; i < parent->count; ++i) {
+                parent->keys[i - 1] = parent->keys[i];
+            }
+            for (std::size_t i = index + 1; i <= parent->count; ++i) {
+                parent->children[i - 1] = parent->children[i];
+            }
+            --parent->count;
+            collapseRoot();
+            return;
+        }
+        root = nullptr;
+    }
+
+    void collapseRoot() {
+        while (!root->isLeaf && root->count == 0) {
+            Node *child = root->children[0];
+            releaseNode(root);
+            root = child;
+        }
+    }
+
+    std::pmr::memory_resource *resource;
+    Node *root = nullptr;
+    // Leftmost leaf, its first key is the best price. Null when the tree is empty
+    Node *first = nullptr;
+    Node *freeNodes = nullptr;
+    std::pmr::vector<Level> values;
+    std::pmr::vector<std::uint32_t> freeSlots;
+};
+
+#endif
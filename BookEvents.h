@@ -0,0 +1,55 @@
+#ifndef BOOK_EVENTS_H
+#define BOOK_EVENTS_H
+#include "TradeRequest.h"
+#include "SpscRing.h"
+#include <cstdint>
+#include <vector>
+
+enum class BookEventType : std::uint8_t {
+    Add, // An order came to rest
+    Execute, // A resting order traded all of its remaining quantity and left the book
+    PartialExecute, // A resting order traded part of its quantity
+    Reduce, // Quantity was taken off a resting order by reduceOrder, it keeps its place
+    Delete, // A resting order was cancelled, quantity is what it had left
+};
+
+// Market by order record published by the book for every change to a resting order (see
+// OrderBookConfig::eventRing). Sequence numbers start at 1 and have no gaps, a consumer that sees one missed the
+// records the ring had no room for
+struct BookEvent {
+    std::uint64_t sequence;
+    std::int64_t orderId;
+    std::uint64_t price;
+    std::uint32_t quantity; // Resting quantity for Add, what was taken or left otherwise
+    BookEventType type;
+    std::uint8_t side; // Side::Buy or Side::Sell
+    std::uint8_t padding[2];
+};
+
+static_assert(sizeof(BookEvent) == 32);
+
+using BookEventRing = SpscRing<BookEvent>;
+
+// Applies a record to a replica of the publishing book, which ends up with the same orders in the same queue
+// positions. The records refer to orders by id, so ids have to be unique among the resting orders, like removeOrder
+// by id expects. False when the record does not fit the replica
+template<typename Book>
+bool applyBookEvent(Book &replica, const BookEvent &event) {
+    switch (event.type) {
+        case BookEventType::Add: {
+            Order order{event.orderId, event.quantity, event.price, static_cast<Side>(event.side)};
+            // A resting order never crosses the book it rested in, so this does not trade or allocate
+            std::vector<TradeRequest> trades;
+            return replica.addOrder(order, trades).valid();
+        }
+        case BookEventType::Execute:
+        case BookEventType::PartialExecute:
+        case BookEventType::Reduce:
+            return replica.reduceOrder(event.orderId, event.quantity);
+        case BookEventType::Delete:
+            return replica.removeOrder(event.orderId);
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef COMPACT_ORDER_H
+#define COMPACT_ORDER_H
+#include "TradeRequest.h"
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+
+// Index of a resting order in the OrderStore, only meaningful inside the book
+using OrderHandle = std::uint32_t;
+
+constexpr OrderHandle nullOrderHandle = UINT32_MAX;
+
+// Reference to a resting order handed out by OrderBook::addOrder. The generation of a slot moves on every time the
+// slot is released, so a reference to an order that was filled or cancelled in the meantime no longer matches and
+// can be rejected without consulting the id lookup. Generations wrap after 2^32 reuses of the same slot
+struct OrderRef {
+    OrderHandle handle = nullOrderHandle;
+    std::uint32_t generation = 0;
+
+    // False when the order did not rest in the book, e.g. it was filled completely on entry
+    bool valid() const { return handle != nullOrderHandle; }
+};
+
+// Largest price offset from the book's base price that fits next to the side bit
+constexpr Price maxPriceTicks = (Price{1} << 31) - 1;
+
+// Internal layout of a resting order. The public Order is 32 bytes and a std::list node around it 48, this is 16 so
+// four orders share a cache line. The price is stored as a tick offset from the book's base price with the side in
+// the lowest bit, and the external OrderId is kept in a separate cold array indexed by the same handle because it
+// is only needed when a trade is reported
+struct CompactOrder {
+    Quantity quantity;
+    std::uint32_t priceAndSide;
+    // Owned by the queue policy of the level the order rests on, and by OrderStore's free list once released
+    OrderHandle prev;
+    OrderHandle next;
+
+    std::uint32_t priceTicks() const { return priceAndSide >> 1; }
+    Side side() const { return static_cast<Side>(priceAndSide & 1); }
+
+    static std::uint32_t pack(const std::uint32_t priceTicks, const Side side) {
+        return priceTicks << 1 | static_cast<std::uint32_t>(side);
+    }
+};
+
+static_assert(sizeof(CompactOrder) == 16);
+
+// Slab of compact orders addressed by handle. Released slots are chained through CompactOrder::next and reused
+// before the slab grows, so the handles stay dense. The external id and the generation of each slot sit in their own
+// arrays since the matching loop needs neither
+class OrderStore {
+public:
+    explicit OrderStore(std::pmr::memory_resource *resource)
+        : orders(resource), orderIds(resource), generations(resource) {
+    }
+
+    void reserve(const std::size_t capacity) {
+        orders.reserve(capacity);
+        orderIds.reserve(capacity);
+        generations.reserve(capacity);
+    }
+
+    OrderHandle allocate(const OrderId orderId, const CompactOrder &order) {
+        OrderHandle handle = freeHead;
+        if (handle != nullOrderHandle) {
+            freeHead = orders[handle].next;
+            orders[handle] = order;
+            orderIds[handle] = orderId;
+        } else {
+            handle = static_cast<OrderHandle>(orders.size());
+            orders.push_back(order);
+            orderIds.push_back(orderId);
+            generations.push_back(0);
+        }
+        return handle;
+    }
+
+    void release(const OrderHandle handle) {
+        orders[handle].next = freeHead;
+        freeHead = handle;
+        ++generations[handle];
+    }
+
+    // Invalidates the references to an order whose slot is released later, see OrderBookConfig::lazyCancels
+    void retire(const OrderHandle handle) { ++generations[handle]; }
+
+    // Slot the next allocate will reuse, nullOrderHandle when it appends a new one
+    OrderHandle nextFree() const { return freeHead; }
+
+    OrderRef ref(const OrderHandle handle) const { return OrderRef{handle, generations[handle]}; }
+
+    // Whether the reference still names a resting order. A released slot already carries the generation its next
+    // occupant will get, which no reference has been handed out for yet
+    bool isLive(const OrderRef ref) const {
+        return ref.handle < generations.size() && generations[ref.handle] == ref.generation;
+    }
+
+    CompactOrder &operator[](const OrderHandle handle) { return orders[handle]; }
+    const CompactOrder &operator[](const OrderHandle handle) const { return orders[handle]; }
+
+    OrderId orderId(const OrderHandle handle) const { return orderIds[handle]; }
+
+private:
+    std::pmr::vector<CompactOrder> orders;
+    std::pmr::vector<OrderId> orderIds;
+    std::pmr::vector<std::uint32_t> generations;
+    OrderHandle freeHead = nullOrderHandle;
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef CONFLATED_LEVELS_H
+#define CONFLATED_LEVELS_H
+#include "OrderBook.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+
+// Latest state of every price level, fed with the book's level updates (see OrderBookConfig::publishLevelUpdates),
+// for subscribers that can not take every update. A subscriber that catches up gets each level that changed since
+// its last catch-up once, with its current totals, however often it changed in between.
+//
+// Levels sit in slots stamped with the version of their last change, plus one stamp per 64 slots, which is the
+// dirty bitset every subscriber reads against its own last version: applying an update is a probe of an open
+// addressing index and a few stores whatever the number of subscribers, and a catch-up only visits the groups of 64
+// that changed. The slot of a level that went away is reused once every subscriber has been told; until then it waits
+// on a list threaded through the slots themselves, so a stalled subscriber holds on to at most one slot per level
+// and never makes the view allocate per update.
+//
+// Not thread safe, like the book: apply and every catchUp have to run on one thread. Fed straight from the book,
+// that is the matching thread, and a subscriber catching up there holds the matcher up for as long as it takes.
+// To keep subscribers off the matching thread, hand the level updates over through an SpscRing (see SpscRing.h)
+// and keep the view on the consuming thread, where it is applied and caught up with; the matcher then only pushes
+// records into the ring. A push that finds the ring full loses the update and leaves its level stale, so the ring
+// has to cover what the consuming thread can fall behind by, not what the subscribers can
+class ConflatedLevels {
+public:
+    explicit ConflatedLevels(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : slots(resource), groupVersions(resource), buckets(16, resource), freeSlots(resource), subscribers(resource) {
+    }
+
+    void reserve(const std::size_t levels) {
+        slots.reserve(levels);
+        groupVersions.reserve(levels / 64 + 1);
+        freeSlots.reserve(levels);
+        if (buckets.size() < 2 * levels) {
+            rehash(std::bit_ceil(2 * levels));
+        }
+    }
+
+    void apply(const LevelUpdate &update) {
+        const std::uint64_t key = keyOf(update);
+        std::size_t bucket = find(key);
+        if (buckets[bucket].slot == empty) {
+            if (2 * (slots.size() - freeSlots.size() + 1) > buckets.size()) {
+                rehash(2 * buckets.size());
+                bucket = find(key);
+            }
+            buckets[bucket] = Bucket{key, allocateSlot()};
+        }
+        const std::uint32_t index = buckets[bucket].slot;
+        Slot &slot = slots[index];
+        slot.level = update;
+        slot.version = ++version;
+        groupVersions[index / 64] = version;
+        if (update.orderCount == 0 && !slot.listed) {
+            slot.listed = true;
+            slot.nextRemoved = noSlot;
+            if (lastRemoved == noSlot) {
+                firstRemoved = index;
+            } else {
+                slots[lastRemoved].nextRemoved = index;
+            }
+            lastRemoved = index;
+        }
+    }
+
+    void apply(const std::pmr::vector<LevelUpdate> &updates) {
+        for (const LevelUpdate &update: updates) {
+            apply(update);
+        }
+    }
+
+    // The first catch-up of a new subscriber reports every level there is
+    std::size_t subscribe() {
+        const auto free = std::find(subscribers.begin(), subscribers.end(), unsubscribed);
+        if (free != subscribers.end()) {
+            *free = 0;
+            return static_cast<std::size_t>(free - subscribers.begin());
+        }
+        subscribers.push_back(0);
+        return subscribers.size() - 1;
+    }
+
+    void unsubscribe(const std::size_t subscriber) { subscribers[subscriber] = unsubscribed; }
+
+    // Calls visit(const LevelUpdate &) for every level that changed since the subscriber's last catch-up, in no
+    // particular order, and returns how many there were
+    template<typename Visit>
+    std::size_t catchUp(const std::size_t subscriber, Visit &&visit) {
+        const std::uint64_t seen = subscribers[subscriber];
+        std::size_t count = 0;
+        for (std::size_t group = 0; group < groupVersions.size(); ++group) {
+            if (groupVersions[group] <= seen) continue;
+            const std::size_t end = std::min(slots.size(), group * 64 + 64);
+            for (std::size_t slot = group * 64; slot < end; ++slot) {
+                // A new subscriber never had the levels that went away
+                const Slot &changed = slots[slot];
+                if (changed.version <= seen || (seen == 0 && changed.level.orderCount == 0)) continue;
+                visit(changed.level);
+                ++count;
+            }
+        }
+        subscribers[subscriber] = version;
+        reclaim();
+        return count;
+    }
+
+private:
+    static constexpr std::uint64_t unsubscribed = UINT64_MAX;
+    static constexpr std::uint32_t empty = UINT32_MAX;
+    static constexpr std::uint32_t noSlot = UINT32_MAX;
+
+    struct Slot {
+        LevelUpdate level;
+        std::uint64_t version;
+        // Next slot on the list of levels that went away, while listed
+        std::uint32_t nextRemoved;
+        bool listed;
+    };
+
+    struct Bucket {
+        std::uint64_t key;
+        std::uint32_t slot = empty;
+    };
+
+    std::uint32_t allocateSlot() {
+        if (!freeSlots.empty()) {
+            const std::uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        slots.push_back(Slot{});
+        if (slots.size() > groupVersions.size() * 64) {
+            groupVersions.push_back(0);
+        }
+        return static_cast<std::uint32_t>(slots.size() - 1);
+    }
+
+    // Frees the slots of levels that went away before the oldest subscriber's last catch-up, and takes the ones that
+    // came back off the list. A slot stays where it was listed when its level goes away again, which at worst keeps
+    // the slots behind it waiting a little longer
+    void reclaim() {
+        std::uint64_t oldest = version;
+        for (const std::uint64_t seen: subscribers) {
+            if (seen != unsubscribed) oldest = std::min(oldest, seen);
+        }
+        while (firstRemoved != noSlot) {
+            Slot &slot = slots[firstRemoved];
+            const bool gone = slot.level.orderCount == 0;
+            if (gone && slot.version > oldest) break;
+            const std::uint32_t index = firstRemoved;
+            firstRemoved = slot.nextRemoved;
+            if (firstRemoved == noSlot) lastRemoved = noSlot;
+            slot.listed = false;
+            if (gone) {
+                erase(find(keyOf(slot.level)));
+                // Still stamped, subscribers that have seen the version skip it and new ones skip it as gone
+                freeSlots.push_back(index);
+            }
+        }
+    }
+
+    static std::uint64_t keyOf(const LevelUpdate &level) {
+        return level.price << 1 | static_cast<std::uint64_t>(level.side);
+    }
+
+    // Bucket holding the key, or the empty one it would go into. Linear probing from a Fibonacci hash
+    std::size_t find(const std::uint64_t key) const {
+        const std::size_t mask = buckets.size() - 1;
+        std::size_t bucket = (key * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+        while (buckets[bucket].slot != empty && buckets[bucket].key != key) {
+            bucket = (bucket + 1) & mask;
+        }
+        return bucket;
+    }
+
+    // Moves later entries of the probe run back into the gap so lookups never need tombstones
+    void erase(std::size_t bucket) {
+        const std::size_t mask = buckets.size() - 1;
+        buckets[bucket].slot = empty;
+        for (std::size_t next = (bucket + 1) & mask; buckets[next].slot != empty; next = (next + 1) & mask) {
+            const std::size_t home = (buckets[next].key * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+            // The entry can fill the gap unless its home lies cyclically in (bucket, next]
+            if (((next - home) & mask) >= ((next - bucket) & mask)) {
+                buckets[bucket] = buckets[next];
+                buckets[next].slot = empty;
+                bucket = next;
+            }
+        }
+    }
+
+    void rehash(const std::size_t size) {
+        std::pmr::vector<Bucket> previous(size, buckets.get_allocator());
+        previous.swap(buckets);
+        for (const Bucket &entry: previous) {
+            if (entry.slot != empty) buckets[find(entry.key)] = entry;
+        }
+    }
+
+    std::pmr::vector<Slot> slots;
+    std::pmr::vector<std::uint64_t> groupVersions;
+    // Power of two, at most half full
+    std::pmr::vector<Bucket> buckets;
+    std::pmr::vector<std::uint32_t> freeSlots;
+    // Levels that went away, in the order they were listed
+    std::uint32_t firstRemoved = noSlot;
+    std::uint32_t lastRemoved = noSlot;
+    // Version each subscriber caught up to
+    std::pmr::vector<std::uint64_t> subscribers;
+    std::uint64_t version = 0;
+};
+
+#endif
@@ -0,0 +1,937 @@
+#include "Conformance.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include "OrderBook.h"
+#include "ConflatedLevels.h"
+#include "SharedMarketData.h"
+
+
+namespace {
+    struct Checker {
+        std::ostream &log;
+        const char *backend;
+        const char *scenario = "";
+        bool passed = true;
+
+        void expect(const bool condition, const std::string &what) {
+            if (condition) return;
+            log << backend << ", " << scenario << ": " << what << std::endl;
+            passed = false;
+        }
+    };
+
+    // Compact text forms so expectations read like the book, e.g. "100:1x10,2x5 99:3x1" for a side
+    template<typename Levels>
+    std::string describe(const Levels &levels) {
+        std::string text;
+        for (const auto &[price, orders]: levels) {
+            if (!text.empty()) text += ' ';
+            text += std::to_string(price);
+            char separator = ':';
+            for (const Order &order: orders) {
+                text += separator;
+                text += std::to_string(order.orderId);
+                text += 'x';
+                text += std::to_string(order.quantity);
+                separator = ',';
+            }
+        }
+        return text;
+    }
+
+    std::string describe(const std::vector<TradeRequest> &trades) {
+        std::string text;
+        for (const TradeRequest &trade: trades) {
+            if (!text.empty()) text += ' ';
+            text += std::to_string(trade.aggressorOrderId);
+            text += '/';
+            text += std::to_string(trade.restingOrderId);
+            text += '@';
+            text += std::to_string(trade.price);
+            text += 'x';
+            text += std::to_string(trade.quantity);
+        }
+        return text;
+    }
+
+    template<typename Book>
+    std::string describeDepth(const Book &book, const Side side, const std::size_t maxLevels) {
+        std::vector<PriceLevel> levels(maxLevels);
+        const std::size_t count = book.getDepth(side, levels.data(), maxLevels);
+        std::string text;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!text.empty()) text += ' ';
+            text += std::to_string(levels[i].price);
+            text += ':';
+            text += std::to_string(levels[i].quantity);
+            text += '/';
+            text += std::to_string(levels[i].orderCount);
+        }
+        return text;
+    }
+
+    template<typename Book>
+    std::string describeLevel(const Book &book, const Side side, const Price price) {
+        const PriceLevel level = book.getLevel(side, price);
+        std::string text = std::to_string(level.price);
+        text += ':';
+        text += std::to_string(level.quantity);
+        text += '/';
+        text += std::to_string(level.orderCount);
+        return text;
+    }
+
+    template<typename Book>
+    std::string add(Book &book, const OrderId orderId, const Quantity quantity, const Price price, const Side side,
+                    OrderRef *ref = nullptr) {
+        Order order{orderId, quantity, price, side};
+        std::vector<TradeRequest> trades;
+        const OrderRef rested = book.addOrder(order, trades);
+        if (ref != nullptr) *ref = rested;
+        return describe(trades);
+    }
+
+    template<typename Book>
+    void checkPriceTimePriority(Checker &check) {
+        check.scenario = "price time priority";
+        Book book;
+        add(book, 1, 10, 100, Side::Buy);
+        add(book, 2, 10, 100, Side::Buy);
+        add(book, 3, 5, 101, Side::Buy);
+        add(book, 4, 7, 103, Side::Sell);
+        check.expect(describe(book.getBids()) == "101:3x5 100:1x10,2x10", "bids " + describe(book.getBids()));
+
+        const std::string trades = add(book, 5, 20, 100, Side::Sell);
+        check.expect(trades == "5/3@101x5 5/1@100x10 5/2@100x5", "sweep traded " + trades);
+        check.expect(describe(book.getBids()) == "100:2x5", "bids after sweep " + describe(book.getBids()));
+        check.expect(describe(book.getAsks()) == "103:4x7", "asks after sweep " + describe(book.getAsks()));
+    }
+
+    template<typename Book>
+    void checkRestingRemainder(Checker &check) {
+        check.scenario = "resting remainder";
+        Book book;
+        add(book, 1, 5, 100, Side::Buy);
+
+        OrderRef ref;
+        const std::string trades = add(book, 2, 8, 99, Side::Sell, &ref);
+        check.expect(trades == "2/1@100x5", "traded " + trades);
+        check.expect(ref.valid(), "no reference to the remainder");
+        check.expect(describe(book.getBids()).empty(), "bids " + describe(book.getBids()));
+        check.expect(describe(book.getAsks()) == "99:2x3", "asks " + describe(book.getAsks()));
+
+        add(book, 3, 3, 99, Side::Buy, &ref);
+        check.expect(!ref.valid(), "reference returned for a completely filled order");
+        check.expect(describe(book.getAsks()).empty(), "asks after fill " + describe(book.getAsks()));
+    }
+
+    template<typename Book>
+    void checkCancels(Checker &check) {
+        check.scenario = "cancels";
+        Book book;
+        OrderRef first;
+        OrderRef second;
+        add(book, 1, 10, 100, Side::Buy, &first);
+        add(book, 2, 10, 100, Side::Buy, &second);
+        add(book, 3, 10, 101, Side::Sell);
+
+        check.expect(!book.removeOrder(OrderId{42}), "unknown id removed");
+        check.expect(book.removeOrder(OrderId{1}), "resting order not removed");
+        check.expect(!book.removeOrder(OrderId{1}), "order removed twice");
+        check.expect(!book.removeOrder(first), "reference to a cancelled order removed");
+        check.expect(book.findOrder(2).handle == second.handle, "findOrder does not return the resting order");
+
+        add(book, 4, 10, 100, Side::Sell);
+        check.expect(!book.findOrder(2).valid(), "findOrder returns a filled order");
+        check.expect(!book.removeOrder(second), "reference to a filled order removed");
+        check.expect(!book.removeOrder(OrderId{2}), "filled order removed by id");
+
+        // The new order may reuse the slot of a filled one, older references must still be rejected
+        OrderRef reused;
+        add(book, 5, 10, 99, Side::Buy, &reused);
+        check.expect(!book.removeOrder(second), "stale reference removed a reused slot");
+        check.expect(book.removeOrder(reused), "order not removed by reference");
+        check.expect(describe(book.getBids()).empty(), "bids " + describe(book.getBids()));
+        check.expect(describe(book.getAsks()) == "101:3x10", "asks " + describe(book.getAsks()));
+    }
+
+    template<typename Book>
+    void checkPriceRange(Checker &check) {
+        check.scenario = "price range";
+        OrderBookConfig config;
+        config.basePrice = 1000;
+        Book book(config);
+        OrderRef ref;
+        add(book, 1, 10, 999, Side::Buy, &ref);
+        check.expect(!ref.valid(), "price below the base price accepted");
+        add(book, 2, 10, 1000 + maxPriceTicks + 1, Side::Sell, &ref);
+        check.expect(!ref.valid(), "price above the range accepted");
+        add(book, 3, 10, 1000 + maxPriceTicks, Side::Sell, &ref);
+        check.expect(ref.valid(), "highest price in range rejected");
+        check.expect(book.getRejectedOrders() == 2, "rejected " + std::to_string(book.getRejectedOrders()));
+        check.expect(describe(book.getBids()).empty(), "bids " + describe(book.getBids()));
+    }
+
+    template<typename Book>
+    void checkDepth(Checker &check) {
+        check.scenario = "depth";
+        Book book;
+        check.expect(describeDepth(book, Side::Buy, 5).empty(), "depth of an empty book");
+        add(book, 1, 10, 100, Side::Buy);
+        add(book, 2, 15, 100, Side::Buy);
+        add(book, 3, 5, 98, Side::Buy);
+        add(book, 4, 1, 97, Side::Buy);
+        add(book, 5, 4, 102, Side::Sell);
+        check.expect(describeDepth(book, Side::Buy, 5) == "100:25/2 98:5/1 97:1/1",
+                     "bid depth " + describeDepth(book, Side::Buy, 5));
+        check.expect(describeDepth(book, Side::Buy, 2) == "100:25/2 98:5/1",
+                     "truncated bid depth " + describeDepth(book, Side::Buy, 2));
+        check.expect(describeDepth(book, Side::Sell, 5) == "102:4/1", "ask depth " + describeDepth(book, Side::Sell, 5));
+        check.expect(describeLevel(book, Side::Buy, 100) == "100:25/2", "bid level " + describeLevel(book, Side::Buy, 100));
+        check.expect(describeLevel(book, Side::Buy, 99) == "99:0/0", "missing level " + describeLevel(book, Side::Buy, 99));
+        check.expect(describeLevel(book, Side::Sell, 100) == "100:0/0",
+                     "level on the other side " + describeLevel(book, Side::Sell, 100));
+        add(book, 6, 12, 100, Side::Sell);
+        check.expect(describeLevel(book, Side::Buy, 100) == "100:13/1",
+                     "level after a fill " + describeLevel(book, Side::Buy, 100));
+        book.removeOrder(2);
+        check.expect(describeLevel(book, Side::Buy, 100) == "100:0/0",
+                     "level after a cancel " + describeLevel(book, Side::Buy, 100));
+    }
+
+    // Levels far apart, so a ladder with a small window keeps some outside of it and recenters when they trade
+    template<typename Book>
+    void checkDistantLevels(Checker &check) {
+        check.scenario = "distant levels";
+        OrderBookConfig config;
+        config.ladderTicks = 64;
+        Book book(config);
+        add(book, 1, 10, 10000, Side::Buy);
+        add(book, 2, 10, 9500, Side::Buy);
+        add(book, 3, 10, 10500, Side::Buy);
+        add(book, 4, 10, 9000, Side::Buy);
+        check.expect(book.removeOrder(OrderId{2}), "distant level not removed");
+        check.expect(describeDepth(book, Side::Buy, 5) == "10500:10/1 10000:10/1 9000:10/1",
+                     "depth " + describeDepth(book, Side::Buy, 5));
+
+        const std::string trades = add(book, 5, 25, 9000, Side::Sell);
+        check.expect(trades == "5/3@10500x10 5/1@10000x10 5/4@9000x5", "sweep traded " + trades);
+        add(book, 6, 10, 20000, Side::Buy);
+        check.expect(describe(book.getBids()) == "20000:6x10 9000:4x5", "bids " + describe(book.getBids()));
+    }
+
+    template<typename Book>
+    std::string describeFillPrice(const Book &book, const Side side, const std::uint64_t quantity) {
+        Price price = 0;
+        return book.getFillPrice(side, quantity, price) ? std::to_string(price) : "none";
+    }
+
+    // Cumulative quantity and fill prices, once walking the levels and once through a depth index with a window of 8
+    // ticks, so levels fall outside of it and the window moves when the side does
+    template<typename Book>
+    void checkCumulativeDepth(Checker &check) {
+        for (const std::size_t ticks: {std::size_t{0}, std::size_t{8}}) {
+            check.scenario = ticks == 0 ? "cumulative depth" : "cumulative depth indexed";
+            OrderBookConfig config;
+            config.depthIndexTicks = ticks;
+            Book book(config);
+            check.expect(book.getCumulativeQuantity(Side::Sell, 200) == 0, "quantity of an empty side");
+            check.expect(describeFillPrice(book, Side::Sell, 1) == "none", "fill price on an empty side");
+            add(book, 1, 10, 101, Side::Sell);
+            add(book, 2, 20, 103, Side::Sell);
+            add(book, 3, 5, 103, Side::Sell);
+            add(book, 4, 40, 130, Side::Sell);
+            add(book, 5, 7, 99, Side::Buy);
+            add(book, 6, 3, 90, Side::Buy);
+
+            check.expect(book.getCumulativeQuantity(Side::Sell, 100) == 0, "asks through 100");
+            check.expect(book.getCumulativeQuantity(Side::Sell, 101) == 10, "asks through 101");
+            check.expect(book.getCumulativeQuantity(Side::Sell, 110) == 35, "asks through 110");
+            check.expect(book.getCumulativeQuantity(Side::Sell, 130) == 75, "asks through 130");
+            check.expect(book.getCumulativeQuantity(Side::Buy, 95) == 7, "bids down to 95");
+            check.expect(book.getCumulativeQuantity(Side::Buy, 90) == 10, "bids down to 90");
+            check.expect(describeFillPrice(book, Side::Sell, 10) == "101", "fill price of 10");
+            check.expect(describeFillPrice(book, Side::Sell, 11) == "103", "fill price of 11");
+            check.expect(describeFillPrice(book, Side::Sell, 36) == "130", "fill price of 36");
+            check.expect(describeFillPrice(book, Side::Sell, 76) == "none", "fill price beyond the side");
+            check.expect(describeFillPrice(book, Side::Buy, 8) == "90", "bid fill price of 8");
+
+            // A better level, a fill and a cancel, then the side moves away from the window entirely
+            add(book, 7, 4, 100, Side::Sell);
+            add(book, 8, 12, 101, Side::Buy);
+            book.removeOrder(OrderId{2});
+            check.expect(book.getCumulativeQuantity(Side::Sell, 103) == 7, "asks through 103 after trading");
+            check.expect(describeFillPrice(book, Side::Sell, 8) == "130", "fill price after trading");
+            add(book, 9, 40, 130, Side::Buy);
+            add(book, 10, 6, 150, Side::Sell);
+            add(book, 11, 6, 170, Side::Sell);
+            check.expect(book.getCumulativeQuantity(Side::Sell, 160) == 13, "asks through 160 after moving");
+            check.expect(describeFillPrice(book, Side::Sell, 14) == "170", "fill price after moving");
+        }
+    }
+
+    // The fills written followed by the summary, e.g. "7/1@101x10 | 10 0 1 1 101 101.0000"
+    template<typename Book>
+    std::string describeSimulation(const Book &book, const Order &order, const std::size_t maxFills) {
+        std::vector<TradeRequest> fills(maxFills);
+        const FillSimulation simulation = book.simulateOrder(order, fills.data(), maxFills);
+        fills.resize(std::min(simulation.fillCount, maxFills));
+        char summary[128];
+        std::snprintf(summary, sizeof(summary), " | %u %u %u %zu %llu %.4f", simulation.filledQuantity,
+                      simulation.residualQuantity, simulation.levelsTouched, simulation.fillCount,
+                      static_cast<unsigned long long>(simulation.worstPrice), simulation.averagePrice);
+        return describe(fills) + summary;
+    }
+
+    // Simulated orders have to report what addOrder then does, without changing the book. The lazy run leaves a level
+    // holding nothing but a cancelled order in the way
+    template<typename Book>
+    void checkSimulation(Checker &check) {
+        for (const bool lazy: {false, true}) {
+            check.scenario = lazy ? "simulation lazy" : "simulation";
+            OrderBookConfig config;
+            config.basePrice = 50;
+            config.lazyCancels = lazy;
+            Book book(config);
+            add(book, 1, 10, 101, Side::Sell);
+            add(book, 2, 20, 103, Side::Sell);
+            add(book, 3, 5, 103, Side::Sell);
+            add(book, 4, 40, 130, Side::Sell);
+            add(book, 5, 6, 102, Side::Sell);
+            add(book, 6, 1, 90, Side::Buy);
+            book.removeOrder(OrderId{5});
+            book.removeOrder(OrderId{6});
+            const std::string asks = describe(book.getAsks());
+
+            const Order partial{100, 25, 103, Side::Buy};
+            check.expect(describeSimulation(book, partial, 8) == "100/1@101x10 100/2@103x15 | 25 0 2 2 103 102.2000",
+                         "partial level " + describeSimulation(book, partial, 8));
+            const Order sweep{100, 100, 200, Side::Buy};
+            check.expect(describeSimulation(book, sweep, 1) == "100/1@101x10 | 75 25 3 4 130 117.1333",
+                         "sweep with a short buffer " + describeSimulation(book, sweep, 1));
+            check.expect(describeSimulation(book, sweep, 0) == " | 75 25 3 4 130 117.1333",
+                         "sweep without a buffer " + describeSimulation(book, sweep, 0));
+            check.expect(describeSimulation(book, Order{100, 7, 100, Side::Buy}, 8) == " | 0 7 0 0 0 0.0000",
+                         "order not crossing");
+            check.expect(describeSimulation(book, Order{100, 7, 10, Side::Sell}, 8) == " | 0 7 0 0 0 0.0000",
+                         "price outside the range");
+            check.expect(describeSimulation(book, Order{100, 7, 200, static_cast<Side>(2)}, 8) == " | 0 7 0 0 0 0.0000",
+                         "invalid side");
+            check.expect(describe(book.getAsks()) == asks, "book changed by simulating " + describe(book.getAsks()));
+
+            const std::string simulated = describeSimulation(book, partial, 8);
+            const std::string trades = add(book, partial.orderId, partial.quantity, partial.price, partial.side);
+            check.expect(simulated.starts_with(trades + " |"), "simulated " + simulated + " traded " + trades);
+        }
+    }
+
+    template<typename Book, typename Order>
+    std::string describeAhead(const Book &book, const Order order) {
+        std::uint64_t quantity = 0;
+        return book.getQuantityAhead(order, quantity) ? std::to_string(quantity) : "none";
+    }
+
+    // Quantity ahead through fills and cancels anywhere in the queue, walked and tracked. The long queue outgrows its
+    // first tree while half of it is cancelled, so the tracked run renumbers it
+    template<typename Book>
+    void checkQueuePositions(Checker &check) {
+        for (const bool tracked: {false, true}) {
+            check.scenario = tracked ? "queue positions tracked" : "queue positions";
+            OrderBookConfig config;
+            config.trackQueuePositions = tracked;
+            Book book(config);
+            OrderRef fourth;
+            add(book, 1, 10, 100, Side::Buy);
+            add(book, 2, 20, 100, Side::Buy);
+            add(book, 3, 5, 100, Side::Buy);
+            add(book, 4, 7, 100, Side::Buy, &fourth);
+            add(book, 5, 9, 99, Side::Buy);
+            check.expect(describeAhead(book, OrderId{1}) == "0", "ahead of the first order");
+            check.expect(describeAhead(book, OrderId{3}) == "30", "ahead of the third order");
+            check.expect(describeAhead(book, fourth) == "35", "ahead of the fourth order by reference");
+            check.expect(describeAhead(book, OrderId{5}) == "0", "ahead on another level");
+            check.expect(describeAhead(book, OrderId{9}) == "none", "ahead of a missing order");
+
+            book.removeOrder(OrderId{2});
+            add(book, 6, 6, 100, Side::Sell);
+            check.expect(describeAhead(book, OrderId{3}) == "4", "ahead after a cancel and a fill");
+            check.expect(describeAhead(book, fourth) == "9", "ahead of the fourth after a cancel and a fill");
+            add(book, 7, 9, 100, Side::Sell);
+            check.expect(describeAhead(book, OrderId{1}) == "none", "ahead of a filled order");
+            check.expect(describeAhead(book, OrderId{4}) == "0", "ahead of the new front");
+
+            std::uint64_t expected = 0;
+            for (OrderId orderId = 100; orderId < 160; ++orderId) {
+                add(book, orderId, static_cast<Quantity>(orderId % 7 + 1), 101, Side::Sell);
+                if (orderId % 2 == 0) {
+                    book.removeOrder(orderId);
+                } else if (orderId != 159) {
+                    expected += orderId % 7 + 1;
+                }
+            }
+            check.expect(describeAhead(book, OrderId{159}) == std::to_string(expected),
+                         "ahead at the back of a long queue " + describeAhead(book, OrderId{159}));
+            add(book, 8, 3, 101, Side::Buy);
+            check.expect(describeAhead(book, OrderId{159}) == std::to_string(expected - 3),
+                         "ahead at the back of a long queue after a fill");
+        }
+    }
+
+    std::uint64_t fnv1a(const std::string &text, std::uint64_t hash = 14695981039346656037ull) {
+        for (const char c: text) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string describe(const std::pmr::vector<LevelUpdate> &updates) {
+        std::string text;
+        for (const LevelUpdate &update: updates) {
+            if (!text.empty()) text += ' ';
+            text += update.side == Side::Buy ? 'B' : 'S';
+            text += std::to_string(update.price);
+            text += ':';
+            text += std::to_string(update.quantity);
+            text += '/';
+            text += std::to_string(update.orderCount);
+        }
+        return text;
+    }
+
+    // Levels as a market data consumer rebuilds them from the level updates alone
+    struct LevelMirror {
+        std::map<Price, PriceLevel, std::greater<Price> > bids;
+        std::map<Price, PriceLevel> asks;
+
+        // False when the call reported a level more than once
+        bool apply(const std::pmr::vector<LevelUpdate> &updates) {
+            bool coalesced = true;
+            for (std::size_t i = 0; i < updates.size(); ++i) {
+                const LevelUpdate &update = updates[i];
+                for (std::size_t j = 0; j < i; ++j) {
+                    coalesced = coalesced && (updates[j].side != update.side || updates[j].price != update.price);
+                }
+                apply(update);
+            }
+            return coalesced;
+        }
+
+        void apply(const LevelUpdate &update) {
+            if (update.side == Side::Buy) {
+                apply(bids, update);
+            } else {
+                apply(asks, update);
+            }
+        }
+
+        template<typename Levels>
+        static void apply(Levels &levels, const LevelUpdate &update) {
+            if (update.orderCount == 0) {
+                levels.erase(update.price);
+            } else {
+                levels[update.price] = PriceLevel{update.price, update.quantity, update.orderCount};
+            }
+        }
+
+        // Same form as describeDepth
+        template<typename Levels>
+        static std::string describeLevels(const Levels &levels) {
+            std::string text;
+            for (const auto &[price, level]: levels) {
+                if (!text.empty()) text += ' ';
+                text += std::to_string(price);
+                text += ':';
+                text += std::to_string(level.quantity);
+                text += '/';
+                text += std::to_string(level.orderCount);
+            }
+            return text;
+        }
+
+        template<typename Book>
+        bool matches(const Book &book) const {
+            return describeDepth(book, Side::Buy, bids.size() + 1) == describeLevels(bids) &&
+                   describeDepth(book, Side::Sell, asks.size() + 1) == describeLevels(asks);
+        }
+    };
+
+    // Takes every record out of the ring, e.g. "1:A7B100x10 2:P7S100x4"
+    std::string drain(BookEventRing &ring) {
+        static constexpr char types[] = {'A', 'E', 'P', 'R', 'D'};
+        std::string text;
+        for (std::span<const BookEvent> events = ring.peek(); !events.empty(); events = ring.peek()) {
+            for (const BookEvent &event: events) {
+                if (!text.empty()) text += ' ';
+                text += std::to_string(event.sequence);
+                text += ':';
+                text += types[static_cast<int>(event.type)];
+                text += std::to_string(event.orderId);
+                text += event.side == static_cast<std::uint8_t>(Side::Buy) ? 'B' : 'S';
+                text += std::to_string(event.price);
+                text += 'x';
+                text += std::to_string(event.quantity);
+            }
+            ring.pop(events.size());
+        }
+        return text;
+    }
+
+    // The records of each kind of change, then a replica fed with nothing but the records of a random workload has to
+    // end up with the same book. The second run has a ring too small for a sweep and has to report what it dropped
+    template<typename Book>
+    void checkEventStream(Checker &check) {
+        check.scenario = "event stream";
+        BookEventRing ring(64);
+        OrderBookConfig config;
+        config.eventRing = &ring;
+        Book book(config);
+        add(book, 1, 10, 100, Side::Buy);
+        add(book, 2, 5, 100, Side::Buy);
+        add(book, 3, 12, 100, Side::Sell);
+        check.expect(book.reduceOrder(OrderId{2}, 1), "reduce a resting order");
+        check.expect(book.removeOrder(OrderId{2}), "cancel a reduced order");
+        check.expect(!book.reduceOrder(OrderId{2}, 1), "reduce a cancelled order");
+        add(book, 4, 6, 101, Side::Sell);
+        check.expect(book.reduceOrder(OrderId{4}, 6), "reduce an order completely");
+        const std::string events = drain(ring);
+        check.expect(events == "1:A1B100x10 2:A2B100x5 3:E1B100x10 4:P2B100x2 5:R2B100x1 6:D2B100x2 7:A4S101x6 "
+                     "8:D4S101x6", "events " + events);
+        check.expect(book.getEventSequence() == 8 && book.getDroppedEvents() == 0, "sequence after the events");
+
+        OrderBookConfig replicaConfig;
+        replicaConfig.ladderTicks = 64;
+        for (const std::size_t capacity: {std::size_t{4096}, std::size_t{4}}) {
+            BookEventRing workloadRing(capacity);
+            OrderBookConfig primaryConfig = replicaConfig;
+            primaryConfig.eventRing = &workloadRing;
+            Book primary(primaryConfig);
+            Book replica(replicaConfig);
+            std::mt19937_64 random(7);
+            std::uint64_t expectedSequence = 1;
+            std::size_t gaps = 0;
+            bool applied = true;
+            for (OrderId orderId = 1; orderId <= 20000; ++orderId) {
+                const Side side = random() % 2 == 0 ? Side::Buy : Side::Sell;
+                const auto price = static_cast<Price>(side == Side::Buy ? 995 + random() % 10 : 1000 + random() % 10);
+                add(primary, orderId, static_cast<Quantity>(1 + random() % 50), price, side);
+                const OrderId other = 1 + static_cast<OrderId>(random() % static_cast<std::uint64_t>(orderId));
+                if (random() % 3 == 0) {
+                    primary.removeOrder(other);
+                } else if (random() % 4 == 0) {
+                    primary.reduceOrder(other, static_cast<Quantity>(1 + random() % 10));
+                }
+                for (std::span<const BookEvent> events = workloadRing.peek(); !events.empty();
+                     events = workloadRing.peek()) {
+                    for (const BookEvent &event: events) {
+                        gaps += event.sequence != expectedSequence;
+                        expectedSequence = event.sequence + 1;
+                        applied = applyBookEvent(replica, event) && applied;
+                    }
+                    workloadRing.pop(events.size());
+                }
+            }
+            if (capacity == 4) {
+                check.expect(primary.getDroppedEvents() > 0 && gaps > 0, "a full ring drops records");
+                continue;
+            }
+            check.expect(applied && gaps == 0 && primary.getDroppedEvents() == 0, "records missing or not applied");
+            check.expect(expectedSequence == primary.getEventSequence() + 1, "sequence of the last record");
+            check.expect(describe(replica.getBids()) == describe(primary.getBids()) &&
+                         describe(replica.getAsks()) == describe(primary.getAsks()), "replica differs");
+        }
+    }
+
+    // The levels a subscriber gets on catching up, sorted so they compare as text and repeats sit next to each other
+    std::pmr::vector<LevelUpdate> catchUp(ConflatedLevels &conflated, const std::size_t subscriber) {
+        std::pmr::vector<LevelUpdate> updates;
+        conflated.catchUp(subscriber, [&](const LevelUpdate &update) { updates.push_back(update); });
+        std::sort(updates.begin(), updates.end(), [](const LevelUpdate &a, const LevelUpdate &b) {
+            return a.side != b.side ? a.side < b.side : a.price < b.price;
+        });
+        return updates;
+    }
+
+    template<typename Book>
+    void checkConflation(Checker &check) {
+        check.scenario = "conflation";
+        OrderBookConfig config;
+        config.publishLevelUpdates = true;
+        Book book(config);
+        ConflatedLevels conflated;
+        const std::size_t fast = conflated.subscribe();
+        const std::size_t slow = conflated.subscribe();
+        const auto publish = [&] { conflated.apply(book.getLevelUpdates()); };
+        add(book, 1, 10, 100, Side::Buy);
+        publish();
+        add(book, 2, 5, 100, Side::Buy);
+        publish();
+        add(book, 3, 7, 102, Side::Sell);
+        publish();
+        std::string updates = describe(catchUp(conflated, fast));
+        check.expect(updates == "B100:15/2 S102:7/1", "first catch-up " + updates);
+
+        add(book, 4, 4, 100, Side::Sell);
+        publish();
+        book.removeOrder(OrderId{3});
+        publish();
+        add(book, 5, 2, 101, Side::Sell);
+        publish();
+        updates = describe(catchUp(conflated, fast));
+        check.expect(updates == "B100:11/2 S101:2/1 S102:0/0", "second catch-up " + updates);
+        updates = describe(catchUp(conflated, slow));
+        check.expect(updates == "B100:11/2 S101:2/1", "slow subscriber " + updates);
+        check.expect(catchUp(conflated, slow).empty(), "nothing changed since");
+
+        // A level that went away and came back is reported with its new totals, a late subscriber only gets what is
+        // there
+        book.removeOrder(OrderId{5});
+        publish();
+        add(book, 6, 3, 101, Side::Sell);
+        publish();
+        updates = describe(catchUp(conflated, slow));
+        check.expect(updates == "S101:3/1", "level that came back " + updates);
+        conflated.unsubscribe(fast);
+        const std::size_t late = conflated.subscribe();
+        check.expect(late == fast, "subscriber slot reused");
+        updates = describe(catchUp(conflated, late));
+        check.expect(updates == "B100:11/2 S101:3/1", "late subscriber " + updates);
+    }
+
+    bool sameLevels(const PriceLevel *a, const PriceLevel *b, const std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (a[i].price != b[i].price || a[i].quantity != b[i].quantity || a[i].orderCount != b[i].orderCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Publishes every change through shared memory and reads it back. Skipped where shared memory is not available
+    template<typename Book>
+    void checkSharedMarketData(Checker &check) {
+        check.scenario = "shared market data";
+        // Replaces what an earlier run that did not get to unlink its object left behind
+        MarketDataPublisher publisher("/orderbook-conformance-" + std::string(check.backend), true);
+        const MarketDataPublisher second("/orderbook-conformance-" + std::string(check.backend));
+        check.expect(!second.available(), "second publisher took over the object");
+        if (!publisher.available()) return;
+        const MarketDataReader reader("/orderbook-conformance-" + std::string(check.backend));
+        check.expect(reader.available(), "reader: " + reader.error());
+        if (!reader.available()) return;
+        DepthSnapshot snapshot{};
+        check.expect(!reader.read(snapshot), "snapshot before the first publish");
+
+        OrderBookConfig config;
+        config.ladderTicks = 64;
+        config.publishLevelUpdates = true;
+        Book book(config);
+        std::mt19937_64 random(11);
+        std::size_t published = 0;
+        std::size_t mismatches = 0;
+        PriceLevel bids[sharedDepthLevels];
+        PriceLevel asks[sharedDepthLevels];
+        for (OrderId orderId = 1; orderId <= 20000; ++orderId) {
+            const Side side = random() % 2 == 0 ? Side::Buy : Side::Sell;
+            // Mostly near the touch, now and then far enough out to land beyond the published levels
+            const Price offset = random() % 20 == 0 ? 20 + random() % 200 : random() % 15;
+            const Price price = side == Side::Buy ? 1000 - offset + random() % 3 : 1001 + offset - random() % 3;
+            add(book, orderId, static_cast<Quantity>(1 + random() % 50), price, side);
+            published += publisher.publishChanges(book);
+            const OrderId other = 1 + static_cast<OrderId>(random() % static_cast<std::uint64_t>(orderId));
+            if (random() % 2 == 0) {
+                book.removeOrder(other);
+            } else {
+                book.reduceOrder(other, static_cast<Quantity>(1 + random() % 10));
+            }
+            published += publisher.publishChanges(book);
+
+            const std::size_t bidLevels = book.getDepth(Side::Buy, bids, sharedDepthLevels);
+            const std::size_t askLevels = book.getDepth(Side::Sell, asks, sharedDepthLevels);
+            mismatches += !reader.read(snapshot) || snapshot.bidLevels != bidLevels ||
+                    snapshot.askLevels != askLevels || !sameLevels(snapshot.bids, bids, bidLevels) ||
+                    !sameLevels(snapshot.asks, asks, askLevels);
+        }
+        check.expect(mismatches == 0, std::to_string(mismatches) + " snapshots differ from the book");
+        check.expect(published < 40000 && snapshot.sequence + 1 == published, "published " +
+                                                                              std::to_string(published));
+    }
+
+    std::string describe(const TopOfBook &top) {
+        std::string text = std::to_string(top.bidQuantity);
+        text += '@';
+        text += std::to_string(top.bidPrice);
+        text += ' ';
+        text += std::to_string(top.askQuantity);
+        text += '@';
+        text += std::to_string(top.askPrice);
+        return text;
+    }
+
+    template<typename Book>
+    TopOfBook topOf(const Book &book) {
+        TopOfBook top{};
+        PriceLevel best{};
+        if (book.getDepth(Side::Buy, &best, 1) == 1) {
+            top.bidPrice = best.price;
+            top.bidQuantity = best.quantity;
+        }
+        if (book.getDepth(Side::Sell, &best, 1) == 1) {
+            top.askPrice = best.price;
+            top.askQuantity = best.quantity;
+        }
+        return top;
+    }
+
+    template<typename Book>
+    void checkTopOfBook(Checker &check) {
+        check.scenario = "top of book";
+        for (const bool lazyCancels: {false, true}) {
+            SeqLock<TopOfBook> top;
+            OrderBookConfig config;
+            config.lazyCancels = lazyCancels;
+            config.topOfBook = &top;
+            Book book(config);
+            const auto expect = [&](const std::uint64_t version, const std::string &expected, const char *what) {
+                const std::string loaded = describe(top.load());
+                check.expect(top.version() == version && loaded == expected,
+                             std::string(what) + ": version " + std::to_string(top.version()) + ", " + loaded);
+            };
+            add(book, 1, 10, 100, Side::Buy);
+            expect(1, "10@100 0@0", "first bid");
+            add(book, 2, 4, 99, Side::Buy);
+            expect(1, "10@100 0@0", "bid behind the touch");
+            add(book, 3, 5, 101, Side::Sell);
+            expect(2, "10@100 5@101", "first ask");
+            add(book, 4, 3, 100, Side::Sell);
+            expect(3, "7@100 5@101", "fill at the touch");
+            book.reduceOrder(OrderId{2}, 1);
+            book.removeOrder(OrderId{42});
+            expect(3, "7@100 5@101", "changes behind the touch");
+            book.removeOrder(OrderId{1});
+            expect(4, "3@99 5@101", "touch cancelled");
+            add(book, 5, 8, 99, Side::Sell);
+            expect(5, "0@0 5@99", "bids swept, the rest of the ask rests at 99");
+        }
+    }
+
+    struct Workload {
+        // One per step
+        std::vector<std::uint64_t> hashes;
+        // Orders that traded differently from their simulation
+        std::size_t simulationMismatches = 0;
+        // Snapshots where the levels rebuilt from the level updates differed from the book, and calls that reported a
+        // level twice
+        std::size_t levelUpdateMismatches = 0;
+        // The same for the subscribers of a conflated view, after each catch-up
+        std::size_t conflationMismatches = 0;
+        // Steps after which the stored top of the book differed from the book, or had been stored more or less
+        // often than the top changed
+        std::size_t topOfBookMismatches = 0;
+    };
+
+    // One hash per step of a random workload: traded fills, returned references, cancel results and level updates,
+    // plus both sides of the book every 64 steps. Prices drift, jump far away now and then and sweep through the
+    // touch. Every order is simulated first, and the level updates are applied to a mirror of the levels and to a
+    // conflated view, whose subscribers catch up at different rates, one of them from half way through. The book
+    // stores its top of book as it goes, which has to change exactly when the best levels do
+    template<typename Book>
+    Workload randomWorkload(const OrderBookConfig &config, const std::uint64_t seed, const std::size_t steps) {
+        SeqLock<TopOfBook> top;
+        OrderBookConfig publishing = config;
+        publishing.topOfBook = &top;
+        Book book(publishing);
+        TopOfBook expectedTop{};
+        std::uint64_t topChanges = 0;
+        std::mt19937_64 random(seed);
+        Workload workload;
+        LevelMirror mirror;
+        ConflatedLevels conflated;
+        struct Subscriber {
+            std::size_t id;
+            std::size_t every;
+            std::size_t from;
+            LevelMirror mirror;
+        };
+        Subscriber subscribers[] = {{0, 5, 0, {}}, {0, 37, 0, {}}, {0, 1000, 0, {}}, {0, 250, steps / 2, {}}};
+        std::vector<OrderRef> refs;
+        std::vector<TradeRequest> trades;
+        Price mid = 100000;
+        OrderId nextOrderId = 1;
+
+        const auto uniform = [&random](const std::uint64_t bound) { return random() % bound; };
+        for (std::size_t step = 0; step < steps; ++step) {
+            std::string outcome;
+            const std::uint64_t kind = uniform(100);
+            if (uniform(20) == 0) mid = mid + uniform(3) - 1;
+
+            if (kind < 50) {
+                const Side side = uniform(2) == 0 ? Side::Buy : Side::Sell;
+                const std::uint64_t shape = uniform(100);
+                Price offset = uniform(20);
+                if (shape < 5) offset = 200 + uniform(2000);
+                const bool aggressive = shape >= 5 && shape < 15;
+                // Passive orders rest on their own side of mid, aggressive ones cross it
+                const bool below = (side == Side::Buy) != aggressive;
+                const Price price = below ? mid - offset - (aggressive ? 0 : 1) : mid + offset + (aggressive ? 0 : 1);
+                // A few ids are reused, what happens to the older order has to be the same everywhere
+                const OrderId orderId = uniform(100) == 0 && nextOrderId > 1
+                                            ? 1 + static_cast<OrderId>(uniform(nextOrderId - 1))
+                                            : nextOrderId++;
+                Order order{orderId, static_cast<Quantity>(1 + uniform(100)), price, side};
+                // Once with a buffer that tends to run out, once with enough room to compare against the trades
+                const std::string simulated = describeSimulation(book, order, 2);
+                const std::string complete = describeSimulation(book, order, 256);
+                trades.clear();
+                const OrderRef ref = book.addOrder(order, trades);
+                if (ref.valid()) refs.push_back(ref);
+                outcome = describe(trades) + (ref.valid() ? " rested" : " filled") + "|" + simulated;
+                workload.simulationMismatches += !complete.starts_with(describe(trades) + " |");
+            } else if (kind < 80) {
+                const OrderId orderId = 1 + static_cast<OrderId>(uniform(nextOrderId));
+                outcome = std::string(book.findOrder(orderId).valid() ? "found " : "missing ") +
+                          (book.removeOrder(orderId) ? "removed" : "rejected");
+            } else if (!refs.empty()) {
+                const std::size_t index = uniform(refs.size());
+                outcome = book.removeOrder(refs[index]) ? "removed" : "rejected";
+                refs[index] = refs.back();
+                refs.pop_back();
+            }
+            if (!refs.empty()) {
+                outcome += " ahead " + describeAhead(book, refs[uniform(refs.size())]);
+            }
+            outcome += '|';
+            outcome += describe(book.getLevelUpdates());
+            workload.levelUpdateMismatches += !mirror.apply(book.getLevelUpdates());
+            conflated.apply(book.getLevelUpdates());
+            const TopOfBook currentTop = topOf(book);
+            if (describe(currentTop) != describe(expectedTop)) {
+                expectedTop = currentTop;
+                ++topChanges;
+            }
+            workload.topOfBookMismatches += describe(top.load()) != describe(expectedTop) ||
+                    top.version() != topChanges;
+            for (Subscriber &subscriber: subscribers) {
+                if (step == subscriber.from) subscriber.id = conflated.subscribe();
+                if (step < subscriber.from || step % subscriber.every != subscriber.every - 1) continue;
+                const std::pmr::vector<LevelUpdate> updates = catchUp(conflated, subscriber.id);
+                workload.conflationMismatches += std::adjacent_find(updates.begin(), updates.end(),
+                    [](const LevelUpdate &a, const LevelUpdate &b) {
+                        return a.side == b.side && a.price == b.price;
+                    }) != updates.end();
+                for (const LevelUpdate &update: updates) subscriber.mirror.apply(update);
+                if (step % 64 == 63 || subscriber.every >= 250) {
+                    workload.conflationMismatches += !subscriber.mirror.matches(book);
+                }
+            }
+
+            if (step % 64 == 63) {
+                workload.levelUpdateMismatches += !mirror.matches(book);
+                outcome += "|" + describe(book.getBids()) + "|" + describe(book.getAsks()) + "|" +
+                        describeDepth(book, Side::Buy, 20) + "|" + describeDepth(book, Side::Sell, 20);
+                for (Price offset = 0; offset < 4; ++offset) {
+                    outcome += "|" + describeLevel(book, Side::Buy, mid - offset) + "|" +
+                            describeLevel(book, Side::Sell, mid + offset);
+                }
+                for (const Price offset: {0, 5, 30, 500}) {
+                    outcome += "|" + std::to_string(book.getCumulativeQuantity(Side::Buy, mid - offset)) + "|" +
+                            std::to_string(book.getCumulativeQuantity(Side::Sell, mid + offset));
+                }
+                for (const std::uint64_t quantity: {1, 100, 1000, 10000}) {
+                    outcome += "|" + describeFillPrice(book, Side::Buy, quantity) + "|" +
+                            describeFillPrice(book, Side::Sell, quantity);
+                }
+            }
+            workload.hashes.push_back(fnv1a(outcome));
+        }
+        return workload;
+    }
+}
+
+bool verifyOrderBookBackends(std::ostream &log) {
+    constexpr std::size_t steps = 50000;
+    constexpr std::uint64_t seeds[] = {1, 2, 3};
+
+    // A small ladder window keeps levels moving between window and map, the same goes for the depth index. The second
+    // config runs on reserved capacity and the third cancels lazily, which has to be indistinguishable from eager
+    // cancels. The reference walks the levels for cumulative depth and the queues for queue positions. All of them
+    // publish level updates
+    OrderBookConfig narrow;
+    narrow.ladderTicks = 64;
+    narrow.depthIndexTicks = 64;
+    narrow.trackQueuePositions = true;
+    narrow.publishLevelUpdates = true;
+    OrderBookConfig reserved{20000, 5000, 1000};
+    reserved.publishLevelUpdates = true;
+    OrderBookConfig lazy = narrow;
+    lazy.lazyCancels = true;
+    const OrderBookConfig *configs[] = {&narrow, &reserved, &lazy};
+
+    std::vector<std::vector<std::uint64_t> > reference;
+    for (const OrderBookConfig *config: configs) {
+        OrderBookConfig eager = *config;
+        eager.lazyCancels = false;
+        eager.depthIndexTicks = 0;
+        eager.trackQueuePositions = false;
+        for (const std::uint64_t seed: seeds) {
+            reference.push_back(randomWorkload<MapListOrderBook>(eager, seed, steps).hashes);
+        }
+    }
+
+    bool passed = true;
+    forEachOrderBookBackend([&]<typename Book>(const char *backend) {
+        Checker check{log, backend};
+        checkPriceTimePriority<Book>(check);
+        checkRestingRemainder<Book>(check);
+        checkCancels<Book>(check);
+        checkPriceRange<Book>(check);
+        checkDepth<Book>(check);
+        checkDistantLevels<Book>(check);
+        checkCumulativeDepth<Book>(check);
+        checkSimulation<Book>(check);
+        checkQueuePositions<Book>(check);
+        checkEventStream<Book>(check);
+        checkConflation<Book>(check);
+        checkSharedMarketData<Book>(check);
+        checkTopOfBook<Book>(check);
+
+        check.scenario = "random workload";
+        std::size_t run = 0;
+        for (const OrderBookConfig *config: configs) {
+            for (const std::uint64_t seed: seeds) {
+                const Workload workload = randomWorkload<Book>(*config, seed, steps);
+                const std::vector<std::uint64_t> &hashes = workload.hashes;
+                const std::vector<std::uint64_t> &expected = reference[run++];
+                std::size_t step = 0;
+                while (step < steps && hashes[step] == expected[step]) ++step;
+                check.expect(step == steps, "seed " + std::to_string(seed) + " ladder ticks " +
+                                            std::to_string(config->ladderTicks) +
+                                            (config->lazyCancels ? " lazy cancels" : "") +
+                                            " differs from map_list at step " + std::to_string(step));
+                check.expect(workload.simulationMismatches == 0, "seed " + std::to_string(seed) + ": " +
+                                                                 std::to_string(workload.simulationMismatches) +
+                                                                 " simulated orders differ from what addOrder did");
+                check.expect(workload.levelUpdateMismatches == 0, "seed " + std::to_string(seed) + ": " +
+                                                                  std::to_string(workload.levelUpdateMismatches) +
+                                                                  " level update mismatches");
+                check.expect(workload.conflationMismatches == 0, "seed " + std::to_string(seed) + ": " +
+                                                                 std::to_string(workload.conflationMismatches) +
+                                                                 " conflated view mismatches");
+                check.expect(workload.topOfBookMismatches == 0, "seed " + std::to_string(seed) + ": " +
+                                                                std::to_string(workload.topOfBookMismatches) +
+                                                                " top of book mismatches");
+            }
+        }
+
+        log << backend << ": " << (check.passed ? "ok" : "FAILED") << std::endl;
+        passed = passed && check.passed;
+    });
+    return passed;
+}
@@ -0,0 +1,12 @@
+#ifndef CONFORMANCE_H
+#define CONFORMANCE_H
+#include <ostream>
+
+
+// Runs the same scripted scenarios and randomised workloads against every OrderBook backend (see
+// forEachOrderBookBackend). Scenarios check the behaviour directly, the random workloads compare every trade, return
+// value and periodic book snapshot against MapListOrderBook. Failures are written to log, returns true when every
+// backend passed
+bool verifyOrderBookBackends(std::ostream &log);
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef DEPTH_INDEX_H
+#define DEPTH_INDEX_H
+#include "TradeRequest.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+
+// Fenwick tree over the level quantities of one side, indexed by the distance in ticks from the start of a window
+// that runs from just better than the best price towards worse prices (see OrderBookConfig::depthIndexTicks). A
+// prefix sum is the quantity resting at a price or better, and the first offset whose prefix reaches a quantity is
+// the price an order needs to go to for it. Both take O(log ticks), and so does keeping it up to date.
+//
+// The book keeps every level inside the window in the tree and re-anchors the window, rebuilding the tree from its
+// levels, when a level appears before the start or the side has moved on. Levels past the end are left out, the book
+// walks its levels for those
+template<typename Compare>
+class DepthIndex {
+public:
+    static constexpr bool highestFirst = std::is_same_v<Compare, std::greater<Price> >;
+
+    DepthIndex(const std::size_t ticks, std::pmr::memory_resource *resource) : tree(ticks + 1, 0, resource) {
+        // Highest power of two not above ticks, where the search for a quantity starts
+        topBit = ticks == 0 ? 0 : std::bit_floor(ticks);
+    }
+
+    bool enabled() const { return tree.size() > 1; }
+
+    // False until the first level arrived, nothing is indexed before
+    bool anchored() const { return isAnchored; }
+
+    std::size_t ticks() const { return tree.size() - 1; }
+
+    // Distance of price from the start of the window, negative when it is better than the start
+    std::int64_t offset(const Price price) const {
+        return highestFirst
+                   ? static_cast<std::int64_t>(start) - static_cast<std::int64_t>(price)
+                   : static_cast<std::int64_t>(price) - static_cast<std::int64_t>(start);
+    }
+
+    bool contains(const Price price) const {
+        const std::int64_t distance = offset(price);
+        return isAnchored && distance >= 0 && distance < static_cast<std::int64_t>(ticks());
+    }
+
+    Price priceAt(const std::size_t distance) const { return highestFirst ? start - distance : start + distance; }
+
+    // Empties the tree and moves the window so price sits a quarter of it from the start, leaving room for better
+    // prices to come
+    void anchor(const Price price) {
+        const Price margin = ticks() / 4;
+        start = highestFirst ? price + margin : price - std::min(price, margin);
+        std::fill(tree.begin(), tree.end(), 0);
+        total = 0;
+        isAnchored = true;
+    }
+
+    // Quantity at the given distance changes by delta, which wraps around for reductions
+    void add(const std::size_t distance, const std::uint64_t delta) {
+        total += delta;
+        for (std::size_t i = distance + 1; i < tree.size(); i += i & -i) {
+            tree[i] += delta;
+        }
+    }
+
+    // Quantity at the distance or closer to the start
+    std::uint64_t prefix(const std::size_t distance) const {
+        std::uint64_t sum = 0;
+        for (std::size_t i = distance + 1; i > 0; i -= i & -i) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+
+    std::uint64_t quantity() const { return total; }
+
+    // Smallest distance whose prefix reaches quantity, which has to be between 1 and quantity()
+    std::size_t find(std::uint64_t quantity) const {
+        std::size_t position = 0;
+        for (std::size_t step = topBit; step > 0; step >>= 1) {
+            if (position + step < tree.size() && tree[position + step] < quantity) {
+                position += step;
+                quantity -= tree[position];
+            }
+        }
+        return position;
+    }
+
+private:
+    std::pmr::vector<std::uint64_t> tree;
+    std::size_t topBit;
+    Price start = 0;
+    std::uint64_t total = 0;
+    bool isAnchored = false;
+};
+
+#endif
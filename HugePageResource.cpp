@@ -0,0 +1,89 @@
+#include "HugePageResource.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+
+namespace {
+    std::size_t roundUp(const std::size_t value, const std::size_t multiple) {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+}
+
+const char *hugePageModeName(const HugePageMode mode) {
+    switch (mode) {
+        case HugePageMode::Explicit: return "explicit";
+        case HugePageMode::Transparent: return "transparent";
+        default: return "none";
+    }
+}
+
+HugePageResource::HugePageResource(const std::size_t regionSize)
+    : regionSize(roundUp(std::max(regionSize, hugePageSize), hugePageSize)) {
+}
+
+HugePageResource::~HugePageResource() {
+    while (regions != nullptr) {
+        Region *next = regions->next;
+#ifdef __linux__
+        munmap(regions->mapping, regions->mappingSize);
+#else
+        ::operator delete(regions->mapping, std::align_val_t(hugePageSize));
+#endif
+        regions = next;
+    }
+}
+
+void *HugePageResource::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+    std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+    if (cursor == nullptr || remaining < padding + bytes) {
+        mapRegion(bytes + alignment + sizeof(Region));
+        padding = (alignment - reinterpret_cast<std::uintptr_t>(cursor) % alignment) % alignment;
+    }
+
+    void *block = cursor + padding;
+    cursor += padding + bytes;
+    remaining -= padding + bytes;
+    return block;
+}
+
+void HugePageResource::mapRegion(const std::size_t minimumSize) {
+    const std::size_t size = roundUp(std::max(minimumSize, regionSize), hugePageSize);
+    void *mapping = nullptr;
+    std::size_t mappingSize = size;
+    std::byte *start = nullptr;
+    HugePageMode mode = HugePageMode::None;
+
+#ifdef __linux__
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapping != MAP_FAILED) {
+        mode = HugePageMode::Explicit;
+        start = static_cast<std::byte *>(mapping);
+    } else {
+        // Over-allocate by one huge page so the usable part can start on a 2MB boundary
+        mappingSize = size + hugePageSize;
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) throw std::bad_alloc();
+        start = reinterpret_cast<std::byte *>(roundUp(reinterpret_cast<std::uintptr_t>(mapping), hugePageSize));
+#ifdef MADV_HUGEPAGE
+        if (madvise(start, size, MADV_HUGEPAGE) == 0) mode = HugePageMode::Transparent;
+#endif
+    }
+#else
+    mapping = ::operator new(size, std::align_val_t(hugePageSize));
+    start = static_cast<std::byte *>(mapping);
+#endif
+
+    regions = new(start) Region{regions, mapping, mappingSize};
+    cursor = start + sizeof(Region);
+    remaining = size - sizeof(Region);
+    totalMapped += mappingSize;
+
+    if (!mapped || static_cast<int>(mode) > static_cast<int>(weakestMode)) weakestMode = mode;
+    mapped = true;
+}
@@ -0,0 +1,58 @@
+#ifndef HUGE_PAGE_RESOURCE_H
+#define HUGE_PAGE_RESOURCE_H
+#include <cstddef>
+#include <memory_resource>
+
+
+enum class HugePageMode {
+    Explicit,    // MAP_HUGETLB, needs pages reserved in /proc/sys/vm/nr_hugepages
+    Transparent, // 2MB aligned mapping with madvise(MADV_HUGEPAGE)
+    None         // Regular pages, when neither of the above is available
+};
+
+const char *hugePageModeName(HugePageMode mode);
+
+// Monotonic memory resource over 2MB aligned regions backed by huge pages where the host allows it. Each region is
+// tried as explicit huge pages first, then as transparent huge pages and finally as regular pages, so it always
+// succeeds when the memory itself is available. Deallocation is a no-op and everything is unmapped on destruction,
+// which makes it a good upstream for NodePool: the pool recycles the small nodes, the regions hold the chunks.
+// Not thread safe
+class HugePageResource : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t hugePageSize = std::size_t{2} << 20;
+
+    explicit HugePageResource(std::size_t regionSize = 32 * hugePageSize);
+    ~HugePageResource() override;
+
+    HugePageResource(const HugePageResource &) = delete;
+    HugePageResource &operator=(const HugePageResource &) = delete;
+
+    // Weakest mode any region ended up with, None until the first allocation
+    HugePageMode mode() const { return weakestMode; }
+
+    std::size_t mappedBytes() const { return totalMapped; }
+
+private:
+    struct Region {
+        Region *next;
+        void *mapping;
+        std::size_t mappingSize;
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *, std::size_t, std::size_t) override {
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override { return this == &other; }
+
+    void mapRegion(std::size_t minimumSize);
+
+    std::size_t regionSize;
+    Region *regions = nullptr;
+    std::byte *cursor = nullptr;
+    std::size_t remaining = 0;
+    std::size_t totalMapped = 0;
+    HugePageMode weakestMode = HugePageMode::None;
+    bool mapped = false;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+
+double tscTicksPerNanosecond() {
+#if defined(__x86_64__) || defined(__i386__)
+    // Spin for a few milliseconds and compare the TSC against the steady clock
+    static const double ticksPerNanosecond = [] {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        const std::uint64_t startTicks = readTsc();
+        while (Clock::now() - start < std::chrono::milliseconds(10)) {
+        }
+        const std::uint64_t ticks = readTsc() - startTicks;
+        const double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        return static_cast<double>(ticks) / nanoseconds;
+    }();
+    return ticksPerNanosecond;
+#else
+    return 1;
+#endif
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(const std::size_t index) {
+    const auto shift = static_cast<int>(index >> subBucketBits) - 1;
+    if (shift <= 0) return index;
+    const std::uint64_t subBucket = index - (static_cast<std::size_t>(shift) << subBucketBits);
+    return ((subBucket + 1) << shift) - 1;
+}
+
+std::uint64_t LatencyHistogram::percentile(const double fraction) const {
+    if (count == 0) return 0;
+    auto rank = static_cast<std::uint64_t>(fraction * static_cast<double>(count));
+    if (rank >= count) rank = count - 1;
+
+    std::uint64_t seen = 0;
+    for (std::size_t index = 0; index < bucketCount; ++index) {
+        seen += counts[index];
+        if (seen > rank) return std::min(bucketUpperBound(index), max);
+    }
+    return max;
+}
+
+void LatencyHistogram::dump(std::ostream &out, const char *name) const {
+    const double ticksPerNanosecond = tscTicksPerNanosecond();
+    const auto nanoseconds = [ticksPerNanosecond](const std::uint64_t ticks) {
+        return static_cast<double>(ticks) / ticksPerNanosecond;
+    };
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-16s count %12llu  p50 %10.0f  p99 %10.0f  p99.9 %10.0f  max %10.0f ns\n",
+                  name, static_cast<unsigned long long>(count), nanoseconds(percentile(0.5)),
+                  nanoseconds(percentile(0.99)), nanoseconds(percentile(0.999)), nanoseconds(max));
+    out << line;
+}
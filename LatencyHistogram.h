@@ -0,0 +1,88 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+#include <bit>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+
+// Raw timestamp counter, falls back to the steady clock in nanoseconds where there is no TSC
+inline std::uint64_t readTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Timestamp counter ticks per nanosecond, measured once on first use
+double tscTicksPerNanosecond();
+
+// Log-linear histogram in the style of HdrHistogram. Values below 2^(subBucketBits + 1) get their own bucket, above
+// that every power of two is split into 2^subBucketBits buckets, so any recorded value is off by at most ~3%.
+// All storage is inline, recording is a handful of instructions and never allocates or locks
+class LatencyHistogram {
+public:
+    static constexpr int subBucketBits = 5;
+    static constexpr std::size_t bucketCount = (65 - subBucketBits) << subBucketBits;
+
+    void record(const std::uint64_t value) {
+        ++counts[bucketIndex(value)];
+        ++count;
+        if (value > max) max = value;
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    std::uint64_t totalCount() const { return count; }
+    std::uint64_t maxValue() const { return max; }
+
+    // Upper bound of the bucket holding the given quantile, 0 when nothing was recorded
+    std::uint64_t percentile(double fraction) const;
+
+    // Writes count, p50, p99, p99.9 and max converted from TSC ticks to nanoseconds
+    void dump(std::ostream &out, const char *name) const;
+
+    static std::size_t bucketIndex(const std::uint64_t value) {
+        const int magnitude = std::bit_width(value | (std::uint64_t{1} << subBucketBits)) - 1;
+        const int shift = magnitude - subBucketBits;
+        return (static_cast<std::size_t>(shift) << subBucketBits) + static_cast<std::size_t>(value >> shift);
+    }
+
+    static std::uint64_t bucketUpperBound(std::size_t index);
+
+private:
+    std::uint64_t counts[bucketCount]{};
+    std::uint64_t count = 0;
+    std::uint64_t max = 0;
+};
+
+// Records the TSC ticks between construction and destruction into a histogram
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram &histogram) : histogram(histogram), start(readTsc()) {
+    }
+
+    ~ScopedLatency() { histogram.record(readTsc() - start); }
+
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+    LatencyHistogram &histogram;
+    std::uint64_t start;
+};
+
+// Instrumentation points compile to nothing unless ORDERBOOK_LATENCY_STATS is defined
+#ifdef ORDERBOOK_LATENCY_STATS
+#define ORDERBOOK_MEASURE_LATENCY(histogram) const ScopedLatency scopedLatency(histogram)
+#else
+#define ORDERBOOK_MEASURE_LATENCY(histogram)
+#endif
+
+#endif
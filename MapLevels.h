@@ -0,0 +1,73 @@
+#ifndef MAP_LEVELS_H
+#define MAP_LEVELS_H
+#include "OrderBookConfig.h"
+#include <map>
+#include <memory_resource>
+
+
+// Level policies keep the price levels of one side of the book, best price first according to Compare, each holding
+// a Level value. Level is the book's: the queue of its queue policy together with the level's aggregates (total
+// quantity, order count), default constructible and movable. The policies only store and move it:
+//
+//   Policy(const OrderBookConfig &, memory_resource *)
+//   void reserve(size_t levels)                 creates what maxLevels levels need up front
+//   static bool better(Price, Price)            whether the first price is strictly better
+//   bool empty() const
+//   Price bestPrice() const                     only when not empty
+//   Level &bestQueue()                          the best level, only when not empty
+//   void eraseBest()
+//   Level &operator[](Price)                    creates an empty level when there is none at the price
+//   Level *find(Price)                          null when there is no level at the price, also const
+//   void erase(Price)                           the level must exist and hold no orders
+//   void forEachLevel(visit) const              visit(Price, const Level &) best first, until it returns false
+//
+// This one is a plain std::map, every level is a tree node
+template<typename Compare, typename Level>
+class MapLevels {
+public:
+    MapLevels(const OrderBookConfig &, std::pmr::memory_resource *resource) : levels(resource) {
+    }
+
+    void reserve(const std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            levels.try_emplace(i);
+        }
+        levels.clear();
+    }
+
+    static bool better(const Price price, const Price other) { return Compare()(price, other); }
+
+    bool empty() const { return levels.empty(); }
+
+    Price bestPrice() const { return levels.begin()->first; }
+
+    Level &bestQueue() { return levels.begin()->second; }
+
+    void eraseBest() { levels.erase(levels.begin()); }
+
+    Level &operator[](const Price price) { return levels[price]; }
+
+    Level *find(const Price price) {
+        const auto level = levels.find(price);
+        return level == levels.end() ? nullptr : &level->second;
+    }
+
+    const Level *find(const Price price) const {
+        const auto level = levels.find(price);
+        return level == levels.end() ? nullptr : &level->second;
+    }
+
+    void erase(const Price price) { levels.erase(price); }
+
+    template<typename Visit>
+    void forEachLevel(Visit &&visit) const {
+        for (const auto &[price, queue]: levels) {
+            if (!visit(price, queue)) return;
+        }
+    }
+
+private:
+    std::pmr::map<Price, Level, Compare> levels;
+};
+
+#endif
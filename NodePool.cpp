@@ -0,0 +1,65 @@
+#include "NodePool.h"
+
+#include <algorithm>
+#include <new>
+
+
+NodePool::NodePool(std::pmr::memory_resource *upstream) : upstream(upstream) {
+}
+
+NodePool::~NodePool() {
+    while (chunks != nullptr) {
+        Chunk *next = chunks->next;
+        upstream->deallocate(chunks, chunks->size, alignof(Chunk));
+        chunks = next;
+    }
+}
+
+void *NodePool::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+    if (bytes > maxBlockSize || alignment > granularity) {
+        return upstream->allocate(bytes, alignment);
+    }
+
+    const std::size_t sizeClass = (std::max<std::size_t>(bytes, 1) - 1) / granularity;
+    if (FreeBlock *block = freeLists[sizeClass]; block != nullptr) {
+        freeLists[sizeClass] = block->next;
+        return block;
+    }
+    return carve((sizeClass + 1) * granularity);
+}
+
+void NodePool::do_deallocate(void *pointer, const std::size_t bytes, const std::size_t alignment) {
+    if (bytes > maxBlockSize || alignment > granularity) {
+        upstream->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    const std::size_t sizeClass = (std::max<std::size_t>(bytes, 1) - 1) / granularity;
+    freeLists[sizeClass] = new(pointer) FreeBlock{freeLists[sizeClass]};
+}
+
+void *NodePool::carve(const std::size_t blockSize) {
+    if (remaining < blockSize) {
+        // Whatever is left of the current chunk is too small for this class, hand it to the smaller classes
+        while (remaining >= granularity) {
+            const std::size_t sizeClass = std::min(remaining / granularity, classCount) - 1;
+            const std::size_t size = (sizeClass + 1) * granularity;
+            freeLists[sizeClass] = new(cursor) FreeBlock{freeLists[sizeClass]};
+            cursor += size;
+            remaining -= size;
+        }
+
+        const std::size_t chunkSize = nextChunkSize;
+        nextChunkSize = std::min(nextChunkSize * 2, maxChunkSize);
+        auto *chunk = static_cast<Chunk *>(upstream->allocate(chunkSize, alignof(Chunk)));
+        chunks = new(chunk) Chunk{chunks, chunkSize};
+        totalChunkBytes += chunkSize;
+        cursor = reinterpret_cast<std::byte *>(chunk + 1);
+        remaining = chunkSize - sizeof(Chunk);
+    }
+
+    void *block = cursor;
+    cursor += blockSize;
+    remaining -= blockSize;
+    return block;
+}
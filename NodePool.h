@@ -0,0 +1,56 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+#include <cstddef>
+#include <memory_resource>
+
+
+// Memory resource for the node based containers inside OrderBook. Small blocks are carved out of large chunks and
+// recycled through one free list per size class, memory is only given back to the upstream resource when the pool
+// is destroyed. Once the pool has seen the peak number of nodes (see OrderBook's capacity configuration) further
+// allocations never reach the upstream resource. Not thread safe, like the book itself
+class NodePool : public std::pmr::memory_resource {
+public:
+    explicit NodePool(std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+    ~NodePool() override;
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    std::pmr::memory_resource *upstreamResource() const { return upstream; }
+
+    // Bytes obtained from the upstream resource for chunks so far
+    std::size_t chunkBytes() const { return totalChunkBytes; }
+
+private:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t maxBlockSize = 512;
+    static constexpr std::size_t classCount = maxBlockSize / granularity;
+    static constexpr std::size_t minChunkSize = 4096;
+    static constexpr std::size_t maxChunkSize = 1 << 20;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    // Chunks are chained through a header at their start so they can be released on destruction
+    struct alignas(granularity) Chunk {
+        Chunk *next;
+        std::size_t size;
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *pointer, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const memory_resource &other) const noexcept override { return this == &other; }
+
+    void *carve(std::size_t blockSize);
+
+    std::pmr::memory_resource *upstream;
+    FreeBlock *freeLists[classCount]{};
+    Chunk *chunks = nullptr;
+    std::byte *cursor = nullptr;
+    std::size_t remaining = 0;
+    std::size_t nextChunkSize = minChunkSize;
+    std::size_t totalChunkBytes = 0;
+};
+
+#endif
@@ -1,117 +1,501 @@
 #include "OrderBook.h"
-#include <iostream>
 #include <fstream>
+#include <type_traits>
 
 
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+BasicOrderBook<LevelPolicy, QueuePolicy>::BasicOrderBook(const OrderBookConfig &config)
+    : config(config),
+      hugePageResource(config.hugePages && config.memoryResource == nullptr
+                           ? std::make_unique<HugePageResource>()
+                           : nullptr),
+      pool(config.memoryResource != nullptr
+               ? nullptr
+               : std::make_unique<NodePool>(hugePageResource != nullptr
+                                                ? hugePageResource.get()
+                                                : std::pmr::get_default_resource())),
+      resource(config.memoryResource == nullptr ? pool.get() : config.memoryResource),
+      store(resource),
+      queues(store, resource),
+      bids(config, resource),
+      asks(config, resource),
+      bidDepth(config.depthIndexTicks, resource),
+      askDepth(config.depthIndexTicks, resource),
+      positions(resource),
+      orderIdLookup(resource),
+      compactPrices(resource),
+      levelUpdates(resource) {
+    store.reserve(config.maxOrders);
+
+    // The node sizes of the standard containers are implementation details, so instead of computing them we create
+    // every node the configured capacity needs once and release it again. The pool keeps them on its free lists.
+    // The lookup entries are held until the queues have created theirs, nodes of the same size class would otherwise
+    // be created from the blocks the other container just released
+    orderIdLookup.reserve(config.maxOrders);
+    for (std::size_t i = 0; i < config.maxOrders; ++i) {
+        orderIdLookup.emplace(static_cast<OrderId>(i), OrderRef());
+    }
+    queues.reserve(config.maxOrders);
+    orderIdLookup.clear();
+    bids.reserve(config.maxLevels);
+    asks.reserve(config.maxLevels);
+    if (config.lazyCancels) {
+        compactPrices.reserve(config.maxLevels);
+    }
+    if (config.publishLevelUpdates) {
+        levelUpdates.reserve(config.maxFillsPerCall + 1);
+    }
+    if (config.trackQueuePositions) {
+        // A tree for every level of both sides, with room for a few orders each
+        positions.reserve(config.maxOrders, 2 * config.maxLevels);
+        for (std::size_t i = 0; i < 2 * config.maxLevels; ++i) {
+            positions.rebuild(positions.acquire(), 0, [](auto &&) {
+            });
+        }
+        for (std::size_t i = 2 * config.maxLevels; i-- > 0;) {
+            positions.release(static_cast<std::uint32_t>(i));
+        }
+    }
+}
+
 // When we add an order we should attempt to match it against any existing orders on the opposite side of the book
-std::vector<TradeRequest> OrderBook::addOrder(Order &order) {
-    const int priceKey = static_cast<int>(order.price);
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+std::vector<TradeRequest> BasicOrderBook<LevelPolicy, QueuePolicy>::addOrder(Order &order) {
     std::vector<TradeRequest> trades;
+    trades.reserve(config.maxFillsPerCall);
+    addOrder(order, trades);
+    return trades;
+}
+
+// Same as above, but appends the trades to a caller owned buffer so a reused buffer does not allocate per call
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+OrderRef BasicOrderBook<LevelPolicy, QueuePolicy>::addOrder(Order &order, std::vector<TradeRequest> &trades) {
+    ORDERBOOK_MEASURE_LATENCY(latencyStats.addOrder);
+    const OrderRef ref = matchOrder(order, trades);
+    publishTopOfBook();
+    return ref;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+OrderRef BasicOrderBook<LevelPolicy, QueuePolicy>::addOrder(Order &order, TradeBuffer &trades) {
+    ORDERBOOK_MEASURE_LATENCY(latencyStats.addOrder);
+    const OrderRef ref = matchOrder(order, trades);
+    publishTopOfBook();
+    return ref;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+TradeBuffer BasicOrderBook<LevelPolicy, QueuePolicy>::makeTradeBuffer() const {
+    TradeBuffer trades(resource);
+    trades.reserve(config.maxFillsPerCall);
+    return trades;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Trades>
+OrderRef BasicOrderBook<LevelPolicy, QueuePolicy>::matchOrder(Order &order, Trades &trades) {
+    levelUpdates.clear();
+    if (order.price < config.basePrice || order.price - config.basePrice > maxPriceTicks) {
+        ++rejectedOrders;
+        return OrderRef();
+    }
 
     if (order.side == Side::Buy) {
         // If Buy price is greater than Sell price, we have a match and can fill the order until either:
         // 1. The incoming order is filled
         // 2. The quantity for the Sell order is exhausted, at which point we should remove that order and move to the next lowest price
         // When we move to the next lowest price we should still check if the prices match
-        while (order.quantity > 0 && !asks.empty() && order.price >= asks.begin()->first) {
-            // We have a match, can start to fill out the order
-            auto &[price, orderList] = *asks.begin();
-            auto &restingOrder = orderList.front();
-            const Quantity tradeQuantity = std::min(order.quantity, restingOrder.quantity);
-
-            trades.emplace_back(TradeRequest{
-                order.orderId,
-                restingOrder.orderId,
-                price,
-                tradeQuantity,
-            });
-
-            order.quantity -= tradeQuantity;
-            restingOrder.quantity -= tradeQuantity;
-
-            if (restingOrder.quantity <= 0) {
-                orderIdLookup.erase(restingOrder.orderId); // Remove from fast lookup table of iterators
-                orderList.pop_front(); // Pop from front of list to remove resting order
-                if (orderList.empty()) {
-                    asks.erase(asks.begin()); // Remove price level if no more orders at that price
-                }
-            }
-        }
+        matchAgainst(order, asks, trades);
 
         // If we have remaining quantity on the order after attempting to match, we should add it to the book
         if (order.quantity > 0) {
-            bids[priceKey].push_back(order);
-            const auto it = std::prev(bids[priceKey].end());
-            orderIdLookup[order.orderId] = it;
+            return restOrder(order, bids);
         }
     } else if (order.side == Side::Sell) {
         // If Sell price is lower than the highest Buy price, we have a match and can fill the order until either:
         // 1. The incoming order is filled
         // 2. The quantity for the Buy order price is exhausted, at which point we should remove that order and move to the next highest price
-        // When we move to the next highest price we should still check if the prices allow for a tra
-        while (order.quantity > 0 && !bids.empty() && order.price <= bids.begin()->first) {
-            auto &[price, orderList] = *bids.begin();
-            auto &restingOrder = orderList.front();
-            const Quantity tradeQuantity = std::min(order.quantity, restingOrder.quantity);
-
-            trades.emplace_back(TradeRequest{
-                order.orderId,
-                restingOrder.orderId,
-                price,
-                tradeQuantity,
-            });
+        // When we move to the next highest price we should still check if the prices allow for a trade
+        matchAgainst(order, bids, trades);
 
-            order.quantity -= tradeQuantity;
-            restingOrder.quantity -= tradeQuantity;
+        if (order.quantity > 0) {
+            return restOrder(order, asks);
+        }
+    } else {
+        ++rejectedOrders;
+    }
+    return OrderRef();
+}
 
-            if (restingOrder.quantity <= 0) {
-                orderIdLookup.erase(restingOrder.orderId);
-                orderList.pop_front();
-                if (orderList.empty()) {
-                    bids.erase(bids.begin());
-                }
+// Levels are ordered best price first, the order crosses a level unless its price is strictly worse than the level's
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels, typename Trades>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::matchAgainst(Order &order, Levels &levels, Trades &trades) {
+    while (order.quantity > 0 && !levels.empty() && !Levels::better(order.price, levels.bestPrice())) {
+        // We have a match, can start to fill out the order
+        const Price price = levels.bestPrice();
+        Level &level = levels.bestQueue();
+        const OrderHandle handle = queues.front(level.queue);
+        CompactOrder &restingOrder = store[handle];
+        if (restingOrder.quantity == 0) {
+            // Cancelled lazily, unlink it now that we are here anyway. It no longer counts towards the level
+            queues.popFront(level.queue);
+            store.release(handle);
+            --deadOrders;
+            --level.deadOrders;
+            if (queues.empty(level.queue)) {
+                releaseLevel(level);
+                levels.eraseBest();
             }
+            continue;
         }
 
-        // If we have remaining quantity on the order after attempting to match, we should add it to the book
-        if (order.quantity > 0) {
-            asks[priceKey].push_back(order);
-            const auto it = std::prev(asks[priceKey].end());
-            orderIdLookup[order.orderId] = it;;
+        const Quantity tradeQuantity = std::min(order.quantity, restingOrder.quantity);
+
+        trades.emplace_back(TradeRequest{
+            order.orderId,
+            store.orderId(handle),
+            price,
+            tradeQuantity,
+        });
+
+        order.quantity -= tradeQuantity;
+        restingOrder.quantity -= tradeQuantity;
+        level.quantity -= tradeQuantity;
+        updateDepthIndex(levels, price, -static_cast<std::uint64_t>(tradeQuantity));
+        if (config.trackQueuePositions) {
+            positions.reduce(handle, tradeQuantity);
+        }
+
+        const bool filled = restingOrder.quantity == 0;
+        publishEvent(filled ? BookEventType::Execute : BookEventType::PartialExecute, handle, tradeQuantity);
+        if (filled) {
+            queues.popFront(level.queue); // Unlink from the front of the queue to remove resting order
+            store.release(handle); // Invalidates references to it, the id lookup entry is cleaned up on reuse
+            --restingOrders;
+            --level.orderCount;
+        }
+        recordLevelUpdate(levels, price, level);
+        if (filled && queues.empty(level.queue)) {
+            releaseLevel(level);
+            levels.eraseBest(); // Remove price level if no more orders at that price
+        }
+    }
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+OrderRef BasicOrderBook<LevelPolicy, QueuePolicy>::restOrder(const Order &order, Levels &levels) {
+    // The slot about to be reused may still be named by the id of its previous order, which was filled or cancelled
+    // by reference. Only an entry pointing at this very slot is stale, the id may have been reused by now
+    if (const OrderHandle reused = store.nextFree(); reused != nullOrderHandle) {
+        const auto stale = orderIdLookup.find(store.orderId(reused));
+        if (stale != orderIdLookup.end() && stale->second.handle == reused) {
+            orderIdLookup.erase(stale);
         }
+    }
+
+    const auto priceTicks = static_cast<std::uint32_t>(order.price - config.basePrice);
+    const OrderHandle handle = store.allocate(order.orderId, CompactOrder{
+                                                  order.quantity,
+                                                  CompactOrder::pack(priceTicks, order.side),
+                                                  nullOrderHandle,
+                                                  nullOrderHandle,
+                                              });
+    Level &level = levels[order.price];
+    queues.pushBack(level.queue, handle);
+    trackPosition(level, handle);
+    level.quantity += order.quantity;
+    ++level.orderCount;
+    ++restingOrders;
+    updateDepthIndex(levels, order.price, order.quantity);
+    recordLevelUpdate(levels, order.price, level);
+    publishEvent(BookEventType::Add, handle, order.quantity);
+
+    const OrderRef ref = store.ref(handle);
+    orderIdLookup[order.orderId] = ref;
+    return ref;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::unlinkOrder(Levels &levels, const Price price,
+                                                          const OrderHandle handle) {
+    Level &level = *levels.find(price);
+    level.quantity -= store[handle].quantity;
+    --level.orderCount;
+    updateDepthIndex(levels, price, -static_cast<std::uint64_t>(store[handle].quantity));
+    if (config.trackQueuePositions) {
+        positions.reduce(handle, store[handle].quantity);
+    }
+    recordLevelUpdate(levels, price, level);
+    if (config.lazyCancels) {
+        // Only the totals change, the order stays linked until matching or compact gets to it
+        ++level.deadOrders;
+        return;
+    }
+
+    queues.remove(level.queue, handle);
+    if (queues.empty(level.queue)) {
+        releaseLevel(level);
+        levels.erase(price);
+    }
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::trackPosition(Level &level, const OrderHandle handle) {
+    if (!config.trackQueuePositions) return;
+    if (level.positionTree == QueuePositions::noTree) {
+        level.positionTree = positions.acquire();
+    }
+    if (positions.full(level.positionTree)) {
+        // Out of tickets, renumber the orders queued before this one. Lazily cancelled ones are left out, nothing
+        // refers to their position any more
+        positions.rebuild(level.positionTree, level.orderCount, [&](auto &&visit) {
+            queues.forEach(level.queue, [&](const OrderHandle queued) {
+                if (queued == handle) return false;
+                if (store[queued].quantity != 0) visit(queued, store[queued].quantity);
+                return true;
+            });
+        });
+    }
+    positions.push(level.positionTree, handle, store[handle].quantity);
+}
+
+// A call changes its levels one after the other: the ones a sweep takes, best first, then the one the remainder rests
+// on. Merging with the last update is therefore all the coalescing it takes to report each of them once
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::recordLevelUpdate(const Levels &, const Price price,
+                                                                 const Level &level) {
+    if (!config.publishLevelUpdates) return;
+    const Side side = std::is_same_v<Levels, BidLevels> ? Side::Buy : Side::Sell;
+    if (!levelUpdates.empty() && levelUpdates.back().price == price && levelUpdates.back().side == side) {
+        levelUpdates.back().quantity = level.quantity;
+        levelUpdates.back().orderCount = level.orderCount;
+        return;
+    }
+    levelUpdates.push_back(LevelUpdate{side, price, level.quantity, level.orderCount});
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::releaseLevel(const Level &level) {
+    if (level.positionTree != QueuePositions::noTree) {
+        positions.release(level.positionTree);
+    }
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::cancel(const OrderHandle handle) {
+    const CompactOrder &order = store[handle];
+    const Price priceKey = config.basePrice + order.priceTicks();
+    const Side side = order.side();
+    publishEvent(BookEventType::Delete, handle, order.quantity);
+
+    if (side == Side::Buy) {
+        unlinkOrder(bids, priceKey, handle);
     } else {
-        std::cerr << "Invalid side, needs to be either Buy or Sell" << std::endl;
+        unlinkOrder(asks, priceKey, handle);
     }
+    --restingOrders;
 
-    return trades;
+    if (config.lazyCancels) {
+        // Nothing left to trade, it stays in its queue until matching reaches it or the book is compacted. Compacting
+        // once dead orders outnumber the resting ones keeps the cost per cancel constant on average. A level whose dead
+        // orders outnumber its live ones is compacted by itself, the same way, so a busy level does not grow its
+        // queue for dead orders in the meantime
+        store[handle].quantity = 0;
+        store.retire(handle);
+        if (++deadOrders > restingOrders) {
+            compact();
+        } else if (side == Side::Buy) {
+            const Level &level = *bids.find(priceKey);
+            if (level.deadOrders > level.orderCount) compactLevel(bids, priceKey);
+        } else {
+            const Level &level = *asks.find(priceKey);
+            if (level.deadOrders > level.orderCount) compactLevel(asks, priceKey);
+        }
+        return;
+    }
+
+    store.release(handle);
 }
 
-void OrderBook::removeOrder(OrderId orderId) {
+// Returns false if the order is not resting in the book, e.g. it was already filled or cancelled
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::removeOrder(OrderId orderId) {
+    ORDERBOOK_MEASURE_LATENCY(latencyStats.removeOrder);
+    levelUpdates.clear();
     const auto mapEntry = orderIdLookup.find(orderId);
 
     if (mapEntry == orderIdLookup.end()) {
-        std::cerr << "Non-existent order id " << orderId << std::endl;
+        return false;
     }
 
-    const auto &orderIt = mapEntry->second;
-    const Order &order = *orderIt;
-    const Price priceKey = order.price;
+    // The entry outlives orders that were filled, erase it either way
+    const OrderRef ref = mapEntry->second;
+    orderIdLookup.erase(mapEntry);
+    if (!store.isLive(ref)) {
+        return false;
+    }
 
-    if (order.side == Side::Buy) {
-        bids.at(priceKey).erase(orderIt);
+    cancel(ref.handle);
+    publishTopOfBook();
+    return true;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::removeOrder(const OrderRef ref) {
+    ORDERBOOK_MEASURE_LATENCY(latencyStats.removeOrder);
+    levelUpdates.clear();
+    if (!store.isLive(ref)) {
+        return false;
+    }
+
+    cancel(ref.handle);
+    publishTopOfBook();
+    return true;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::reduceOrder(const OrderId orderId, const Quantity quantity) {
+    return reduceOrder(findOrder(orderId), quantity);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::reduceOrder(const OrderRef ref, const Quantity quantity) {
+    levelUpdates.clear();
+    if (!store.isLive(ref)) {
+        return false;
+    }
 
-        if (bids.at(priceKey).empty()) {
-            bids.erase(priceKey);
+    const CompactOrder &order = store[ref.handle];
+    if (quantity >= order.quantity) {
+        cancel(ref.handle);
+    } else if (quantity > 0) {
+        const Price price = config.basePrice + order.priceTicks();
+        if (order.side() == Side::Buy) {
+            reduce(bids, price, ref.handle, quantity);
+        } else {
+            reduce(asks, price, ref.handle, quantity);
         }
-    } else if (order.side == Side::Sell) {
-        asks.at(priceKey).erase(orderIt);
+    }
+    publishTopOfBook();
+    return true;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::reduce(Levels &levels, const Price price, const OrderHandle handle,
+                                                      const Quantity quantity) {
+    Level &level = *levels.find(price);
+    store[handle].quantity -= quantity;
+    level.quantity -= quantity;
+    updateDepthIndex(levels, price, -static_cast<std::uint64_t>(quantity));
+    if (config.trackQueuePositions) {
+        positions.reduce(handle, quantity);
+    }
+    recordLevelUpdate(levels, price, level);
+    publishEvent(BookEventType::Reduce, handle, quantity);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::publishEvent(const BookEventType type, const OrderHandle handle,
+                                                            const Quantity quantity) {
+    if (config.eventRing == nullptr) return;
+    const CompactOrder &order = store[handle];
+    const BookEvent event{
+        ++eventSequence,
+        store.orderId(handle),
+        config.basePrice + order.priceTicks(),
+        quantity,
+        type,
+        static_cast<std::uint8_t>(order.side()),
+        {},
+    };
+    if (!config.eventRing->tryPush(event)) {
+        ++droppedEvents;
+    }
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::publishTopOfBook() {
+    if (config.topOfBook == nullptr) return;
+    TopOfBook top{};
+    bestLevel(bids, top.bidPrice, top.bidQuantity);
+    bestLevel(asks, top.askPrice, top.askQuantity);
+    if (top.bidPrice == publishedTop.bidPrice && top.bidQuantity == publishedTop.bidQuantity &&
+        top.askPrice == publishedTop.askPrice && top.askQuantity == publishedTop.askQuantity) {
+        return;
+    }
+    config.topOfBook->store(top);
+    publishedTop = top;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::bestLevel(const Levels &levels, Price &price,
+                                                         std::uint64_t &quantity) {
+    // Only levels left with lazily cancelled orders come before the first live one
+    levels.forEachLevel([&](const Price levelPrice, const Level &level) {
+        if (level.orderCount == 0) return true;
+        price = levelPrice;
+        quantity = level.quantity;
+        return false;
+    });
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::compact() {
+    if (deadOrders == 0) return;
+    compactLevels(bids);
+    compactLevels(asks);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::compactLevels(Levels &levels) {
+    // Levels can not be erased while they are visited, so collect the prices first
+    compactPrices.clear();
+    levels.forEachLevel([&](const Price price, const Level &level) {
+        if (level.deadOrders != 0) compactPrices.push_back(price);
+        return true;
+    });
+
+    for (const Price price: compactPrices) {
+        compactLevel(levels, price);
+    }
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::compactLevel(Levels &levels, const Price price) {
+    Level &level = *levels.find(price);
+    const std::size_t size = level.orderCount + level.deadOrders;
 
-        if (asks.at(priceKey).empty()) {
-            asks.erase(priceKey);
+    // Rotating the queue once through the front drops the dead orders and keeps the others in time priority
+    for (std::size_t i = 0; i < size; ++i) {
+        const OrderHandle handle = queues.front(level.queue);
+        queues.popFront(level.queue);
+        if (store[handle].quantity == 0) {
+            store.release(handle);
+        } else {
+            queues.pushBack(level.queue, handle);
         }
     }
+    deadOrders -= level.deadOrders;
+    level.deadOrders = 0;
+
+    if (queues.empty(level.queue)) {
+        releaseLevel(level);
+        levels.erase(price);
+    }
+}
 
-    orderIdLookup.erase(orderId);
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+OrderRef BasicOrderBook<LevelPolicy, QueuePolicy>::findOrder(const OrderId orderId) const {
+    const auto mapEntry = orderIdLookup.find(orderId);
+    return mapEntry != orderIdLookup.end() && store.isLive(mapEntry->second) ? mapEntry->second : OrderRef();
 }
 
 std::vector<Order> getOrders(std::ifstream &inFile);
@@ -120,3 +504,257 @@ float formatPrice(Price price);
 
 std::vector<std::string> parseTokens(const std::string &line, char delimiter);
 
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Result, typename Levels>
+Result BasicOrderBook<LevelPolicy, QueuePolicy>::copyLevels(const Levels &levels) const {
+    Result result;
+    levels.forEachLevel([&](const Price price, const Level &level) {
+        typename Result::mapped_type orders;
+        queues.forEach(level.queue, [&](const OrderHandle handle) {
+            // Orders cancelled lazily have nothing left and are not reported
+            if (store[handle].quantity != 0) {
+                orders.push_back(Order{store.orderId(handle), store[handle].quantity, price, store[handle].side()});
+            }
+            return true;
+        });
+        if (!orders.empty()) {
+            result.emplace(price, std::move(orders));
+        }
+        return true;
+    });
+    return result;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+std::size_t BasicOrderBook<LevelPolicy, QueuePolicy>::collectDepth(const Levels &book, PriceLevel *levels,
+                                                                   const std::size_t maxLevels) const {
+    std::size_t count = 0;
+    book.forEachLevel([&](const Price price, const Level &level) {
+        if (count == maxLevels) return false;
+        // A level left with only lazily cancelled orders is not reported
+        if (level.orderCount != 0) {
+            levels[count++] = PriceLevel{price, level.quantity, level.orderCount};
+        }
+        return true;
+    });
+    return count;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+PriceLevel BasicOrderBook<LevelPolicy, QueuePolicy>::findLevel(const Levels &levels, const Price price) const {
+    const Level *level = levels.find(price);
+    return level == nullptr ? PriceLevel{price, 0, 0} : PriceLevel{price, level->quantity, level->orderCount};
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+std::map<Price, std::list<Order>, std::greater<Price> > BasicOrderBook<LevelPolicy, QueuePolicy>::getBids() const {
+    return copyLevels<std::map<Price, std::list<Order>, std::greater<Price> > >(bids);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+std::map<Price, std::list<Order> > BasicOrderBook<LevelPolicy, QueuePolicy>::getAsks() const {
+    return copyLevels<std::map<Price, std::list<Order> > >(asks);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+std::size_t BasicOrderBook<LevelPolicy, QueuePolicy>::getDepth(const Side side, PriceLevel *levels,
+                                                               const std::size_t maxLevels) const {
+    return side == Side::Buy ? collectDepth(bids, levels, maxLevels) : collectDepth(asks, levels, maxLevels);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::updateDepthIndex(const Levels &levels, const Price price,
+                                                                const std::uint64_t delta) {
+    auto &index = depthIndexOf(levels);
+    if (!index.enabled()) return;
+    if (index.contains(price)) {
+        index.add(static_cast<std::size_t>(index.offset(price)), delta);
+        return;
+    }
+
+    // Past the end of the window the level is simply left out, unless the side has moved far enough for the window
+    // to be mostly empty. A level before the start is the new best price
+    const auto half = static_cast<std::int64_t>(index.ticks() / 2);
+    if (index.anchored() && index.offset(price) >= 0 && index.offset(levels.bestPrice()) < half) return;
+
+    index.anchor(levels.bestPrice());
+    levels.forEachLevel([&](const Price levelPrice, const Level &level) {
+        if (!index.contains(levelPrice)) return false;
+        index.add(static_cast<std::size_t>(index.offset(levelPrice)), level.quantity);
+        return true;
+    });
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+std::uint64_t BasicOrderBook<LevelPolicy, QueuePolicy>::cumulativeQuantity(const Levels &levels,
+                                                                          const Price price) const {
+    const auto &index = depthIndexOf(levels);
+    std::uint64_t quantity = 0;
+    if (index.anchored()) {
+        if (index.offset(price) < 0) return 0;
+        if (index.contains(price)) return index.prefix(static_cast<std::size_t>(index.offset(price)));
+        quantity = index.quantity();
+    }
+
+    // Without the index, or for the levels past its window
+    levels.forEachLevel([&](const Price levelPrice, const Level &level) {
+        if (Levels::better(price, levelPrice)) return false;
+        if (!index.contains(levelPrice)) quantity += level.quantity;
+        return true;
+    });
+    return quantity;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::fillPrice(const Levels &levels, const std::uint64_t quantity,
+                                                        Price &price) const {
+    if (quantity == 0) return false;
+    const auto &index = depthIndexOf(levels);
+    std::uint64_t filled = 0;
+    if (index.anchored()) {
+        if (index.quantity() >= quantity) {
+            price = index.priceAt(index.find(quantity));
+            return true;
+        }
+        filled = index.quantity();
+    }
+
+    bool found = false;
+    levels.forEachLevel([&](const Price levelPrice, const Level &level) {
+        if (index.contains(levelPrice)) return true;
+        filled += level.quantity;
+        if (filled < quantity) return true;
+        price = levelPrice;
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+std::uint64_t BasicOrderBook<LevelPolicy, QueuePolicy>::getCumulativeQuantity(const Side side,
+                                                                             const Price price) const {
+    return side == Side::Buy ? cumulativeQuantity(bids, price) : cumulativeQuantity(asks, price);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::getFillPrice(const Side side, const std::uint64_t quantity,
+                                                           Price &price) const {
+    return side == Side::Buy ? fillPrice(bids, quantity, price) : fillPrice(asks, quantity, price);
+}
+
+// Same walk as matchAgainst, reading the quantities instead of trading them
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+template<typename Levels>
+FillSimulation BasicOrderBook<LevelPolicy, QueuePolicy>::simulateAgainst(const Order &order, const Levels &levels,
+                                                                        TradeRequest *fills,
+                                                                        const std::size_t maxFills) const {
+    FillSimulation result{0, order.quantity, 0, 0, 0, 0};
+    double notional = 0;
+    levels.forEachLevel([&](const Price price, const Level &level) {
+        if (result.residualQuantity == 0 || Levels::better(order.price, price)) return false;
+        // A level left with only lazily cancelled orders trades nothing
+        if (level.orderCount == 0) return true;
+        ++result.levelsTouched;
+        result.worstPrice = price;
+
+        if (level.quantity <= result.residualQuantity && result.fillCount >= maxFills) {
+            // Taken completely and nothing left to write, the totals say it all
+            const auto quantity = static_cast<Quantity>(level.quantity);
+            result.filledQuantity += quantity;
+            result.residualQuantity -= quantity;
+            result.fillCount += level.orderCount;
+            notional += static_cast<double>(price) * quantity;
+            return true;
+        }
+
+        queues.forEach(level.queue, [&](const OrderHandle handle) {
+            const Quantity resting = store[handle].quantity;
+            if (resting == 0) return true;
+            const Quantity quantity = std::min(result.residualQuantity, resting);
+            if (result.fillCount < maxFills) {
+                fills[result.fillCount] = TradeRequest{order.orderId, store.orderId(handle), price, quantity};
+            }
+            ++result.fillCount;
+            result.filledQuantity += quantity;
+            result.residualQuantity -= quantity;
+            notional += static_cast<double>(price) * quantity;
+            return result.residualQuantity > 0;
+        });
+        return true;
+    });
+    if (result.filledQuantity > 0) {
+        result.averagePrice = notional / result.filledQuantity;
+    }
+    return result;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+FillSimulation BasicOrderBook<LevelPolicy, QueuePolicy>::simulateOrder(const Order &order, TradeRequest *fills,
+                                                                      const std::size_t maxFills) const {
+    // Rejected like matchOrder rejects them
+    if (order.price < config.basePrice || order.price - config.basePrice > maxPriceTicks ||
+        (order.side != Side::Buy && order.side != Side::Sell)) {
+        return FillSimulation{0, order.quantity, 0, 0, 0, 0};
+    }
+    return order.side == Side::Buy
+               ? simulateAgainst(order, asks, fills, maxFills)
+               : simulateAgainst(order, bids, fills, maxFills);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::getQuantityAhead(const OrderId orderId,
+                                                                std::uint64_t &quantity) const {
+    return getQuantityAhead(findOrder(orderId), quantity);
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+bool BasicOrderBook<LevelPolicy, QueuePolicy>::getQuantityAhead(const OrderRef ref, std::uint64_t &quantity) const {
+    if (!store.isLive(ref)) return false;
+    if (config.trackQueuePositions) {
+        quantity = positions.ahead(ref.handle);
+        return true;
+    }
+
+    // Without the trees, walk the queue up to the order
+    const CompactOrder &order = store[ref.handle];
+    const Price price = config.basePrice + order.priceTicks();
+    const Level *level = order.side() == Side::Buy ? bids.find(price) : asks.find(price);
+    quantity = 0;
+    queues.forEach(level->queue, [&](const OrderHandle queued) {
+        if (queued == ref.handle) return false;
+        quantity += store[queued].quantity;
+        return true;
+    });
+    return true;
+}
+
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+PriceLevel BasicOrderBook<LevelPolicy, QueuePolicy>::getLevel(const Side side, const Price price) const {
+    return side == Side::Buy ? findLevel(bids, price) : findLevel(asks, price);
+}
+
+#ifdef ORDERBOOK_LATENCY_STATS
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+void BasicOrderBook<LevelPolicy, QueuePolicy>::dumpLatencyStats(std::ostream &out) const {
+    latencyStats.addOrder.dump(out, "addOrder");
+    latencyStats.removeOrder.dump(out, "removeOrder");
+}
+#endif
+
+template class BasicOrderBook<PriceLadder, LinkedQueues>;
+template class BasicOrderBook<PriceLadder, ListQueues>;
+template class BasicOrderBook<PriceLadder, SmallVectorQueues>;
+template class BasicOrderBook<MapLevels, LinkedQueues>;
+template class BasicOrderBook<MapLevels, ListQueues>;
+template class BasicOrderBook<MapLevels, SmallVectorQueues>;
+template class BasicOrderBook<BTreeLevels, LinkedQueues>;
+template class BasicOrderBook<BTreeLevels, ListQueues>;
+template class BasicOrderBook<VectorLevels, LinkedQueues>;
+template class BasicOrderBook<VectorLevels, ListQueues>;
@@ -1,27 +1,365 @@
 #ifndef ORDER_BOOK_H
 #define ORDER_BOOK_H
 #include "TradeRequest.h"
+#include "CompactOrder.h"
+#include "OrderBookConfig.h"
+#include "OrderQueues.h"
+#include "MapLevels.h"
+#include "PriceLadder.h"
+#include "BTreeLevels.h"
+#include "VectorLevels.h"
+#include "DepthIndex.h"
+#include "QueuePositions.h"
+#include "BookEvents.h"
+#include "SeqLock.h"
+#include "LatencyHistogram.h"
+#include "NodePool.h"
+#include "HugePageResource.h"
 #include <vector>
 #include <unordered_map>
 #include <map>
 #include <list>
+#include <memory>
+#include <memory_resource>
 
+// Aggregated view of a single price level, as returned by depth and level queries
+struct PriceLevel {
+    Price price;
+    std::uint64_t quantity;
+    std::uint32_t orderCount;
+};
+
+// What an order would do to the book, as worked out by simulateOrder without changing anything
+struct FillSimulation {
+    Quantity filledQuantity;
+    Quantity residualQuantity; // Left over to rest in the book
+    std::uint32_t levelsTouched;
+    std::size_t fillCount; // Fills the order would produce, more than were written when the buffer ran out
+    Price worstPrice; // Price of the last fill, 0 without any
+    double averagePrice; // Volume weighted over all fills, 0 without any
+};
+
+// A price level changed by the last addOrder or removeOrder call, with its totals once the call was done. Both are
+// zero when the level went away
+struct LevelUpdate {
+    Side side;
+    Price price;
+    std::uint64_t quantity;
+    std::uint32_t orderCount;
+};
+
+// Best bid and offer with the quantity resting there (see OrderBookConfig::topOfBook). Price and quantity are zero
+// for a side without orders
+struct TopOfBook {
+    Price bidPrice;
+    std::uint64_t bidQuantity;
+    Price askPrice;
+    std::uint64_t askQuantity;
+};
+
+using TradeBuffer = std::pmr::vector<TradeRequest>;
+
+#ifdef ORDERBOOK_LATENCY_STATS
+// Time spent in each public operation, in TSC ticks
+struct OrderBookLatencyStats {
+    LatencyHistogram addOrder;
+    LatencyHistogram removeOrder;
+};
+#endif
 
-class OrderBook {
+// The book is parameterised on how the price levels of a side are stored (LevelPolicy, see MapLevels.h) and how the
+// orders of a level are kept in time priority (QueuePolicy, see OrderQueues.h). Every combination behaves the same,
+// OrderBookBench --verify checks that; they differ in speed and memory depending on the instrument. The
+// combinations below are instantiated in OrderBook.cpp, OrderBook is the default
+template<template<typename, typename> class LevelPolicy, typename QueuePolicy>
+class BasicOrderBook {
 public:
+    BasicOrderBook() : BasicOrderBook(OrderBookConfig()) {
+    }
+
+    explicit BasicOrderBook(const OrderBookConfig &config);
+
+    BasicOrderBook(const BasicOrderBook &) = delete;
+    BasicOrderBook &operator=(const BasicOrderBook &) = delete;
+
+    const OrderBookConfig &getConfig() const { return config; }
+
     std::vector<TradeRequest> addOrder(Order &order);
 
-    void removeOrder(OrderId orderId);
+    // Both return a reference to the part of the order left resting in the book, invalid when nothing rests. An order
+    // priced outside the range of the book or with an invalid side is rejected without trading, see getRejectedOrders
+    OrderRef addOrder(Order &order, std::vector<TradeRequest> &trades);
+
+    OrderRef addOrder(Order &order, TradeBuffer &trades);
+
+    // Empty trade buffer on the book's memory resource with room for maxFillsPerCall trades
+    TradeBuffer makeTradeBuffer() const;
+
+    std::pmr::memory_resource *getMemoryResource() const { return resource; }
+
+    // Page size the book's storage actually got when hugePages was requested, None otherwise
+    HugePageMode getHugePageMode() const {
+        return hugePageResource == nullptr ? HugePageMode::None : hugePageResource->mode();
+    }
+
+    bool removeOrder(OrderId orderId);
+
+    // Cancel without the id lookup, false when the referenced order was already filled or cancelled
+    bool removeOrder(OrderRef ref);
+
+    // Takes quantity off a resting order without it losing its place in the queue, the order is removed when nothing is
+    // left. False when the order does not rest in the book
+    bool reduceOrder(OrderId orderId, Quantity quantity);
+
+    bool reduceOrder(OrderRef ref, Quantity quantity);
+
+    // Translates a client id into a reference, invalid when no order with that id rests in the book
+    OrderRef findOrder(OrderId orderId) const;
+
+    // Unlinks every order cancelled lazily (see OrderBookConfig::lazyCancels) and erases the levels left empty. Runs
+    // by itself when needed, calling it while the book is idle moves that work out of the cancel path
+    void compact();
+
+    // Writes up to maxLevels levels of one side, best price first, and returns how many were written
+    std::size_t getDepth(Side side, PriceLevel *levels, std::size_t maxLevels) const;
+
+    // Total quantity and order count resting at one price, both zero when there is no level there. Kept up to date
+    // on every rest, fill and cancel, so this costs one level lookup
+    PriceLevel getLevel(Side side, Price price) const;
+
+    // Quantity resting on one side at price or better, i.e. what a buy limited to price could take from the asks.
+    // O(log ticks) for a price inside the window of OrderBookConfig::depthIndexTicks. Without the index, or for a
+    // price past the end of its window, the levels are walked from the best one, which costs O(levels)
+    std::uint64_t getCumulativeQuantity(Side side, Price price) const;
+
+    // Worst price an order has to reach on one side to get quantity (> 0) filled, false when the whole side rests
+    // less than that. Costs like getCumulativeQuantity: O(log ticks) when the window of the index holds the quantity,
+    // a walk over the levels otherwise
+    bool getFillPrice(Side side, std::uint64_t quantity, Price &price) const;
+
+    // Works out the fills addOrder would produce for order without touching the book, writing the first maxFills of
+    // them to fills. Only the levels the order reaches are visited, and the orders on them only while fills are
+    // still written or the level is not taken completely. An order addOrder would reject fills nothing
+    FillSimulation simulateOrder(const Order &order, TradeRequest *fills, std::size_t maxFills) const;
+
+    // Quantity resting in front of an order in its queue, i.e. what has to trade or cancel before it gets filled.
+    // False when the order does not rest in the book
+    bool getQuantityAhead(OrderId orderId, std::uint64_t &quantity) const;
+
+    bool getQuantityAhead(OrderRef ref, std::uint64_t &quantity) const;
+
+    // Levels the last addOrder or removeOrder changed, one update per level in the order they were changed, e.g. one
+    // per level a sweep took and one for the level the remainder rests on. Only kept with publishLevelUpdates and
+    // overwritten by the next call
+    const std::pmr::vector<LevelUpdate> &getLevelUpdates() const { return levelUpdates; }
+
+    // Sequence number of the last BookEvent, published or dropped, and how many were dropped because the event ring
+    // was full
+    std::uint64_t getEventSequence() const { return eventSequence; }
+
+    std::uint64_t getDroppedEvents() const { return droppedEvents; }
+
+    // Orders resting in the book, not counting those cancelled lazily
+    std::size_t getRestingOrders() const { return restingOrders; }
+
+    // Orders addOrder turned away for a price outside the range of the book or an invalid side
+    std::uint64_t getRejectedOrders() const { return rejectedOrders; }
+
+    std::map<Price, std::list<Order>, std::greater<Price> > getBids() const;
+    std::map<Price, std::list<Order> > getAsks() const;
+
+#ifdef ORDERBOOK_LATENCY_STATS
+    const OrderBookLatencyStats &getLatencyStats() const { return latencyStats; }
+
+    // Prints p50/p99/p99.9/max of every operation
+    void dumpLatencyStats(std::ostream &out) const;
 
-    std::map<Price, std::list<Order>, std::greater<Price> > getBids() { return bids; }
-    std::map<Price, std::list<Order> > getAsks() { return asks; }
+    void resetLatencyStats() { latencyStats = OrderBookLatencyStats(); }
+#endif
 
 private:
-    std::map<Price, std::list<Order>, std::greater<Price> > bids;
-    std::map<Price, std::list<Order> > asks;
+    using Queue = typename QueuePolicy::Queue;
+
+    // What the level policies store per price: the orders in time priority and their running totals
+    struct Level {
+        // Lets the pmr containers of the level policies hand their resource on to a Queue that takes one
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        Level() = default;
+
+        explicit Level(const allocator_type &allocator) : queue(std::make_obj_using_allocator<Queue>(allocator)) {
+        }
+
+        Level(Level &&other, const allocator_type &allocator)
+            : queue(std::make_obj_using_allocator<Queue>(allocator, std::move(other.queue))),
+              quantity(other.quantity),
+              orderCount(other.orderCount),
+              deadOrders(other.deadOrders),
+              positionTree(other.positionTree) {
+        }
+
+        Level(Level &&) = default;
+        Level &operator=(Level &&) = default;
+
+        Queue queue;
+        std::uint64_t quantity = 0;
+        std::uint32_t orderCount = 0;
+        // Cancelled lazily but still in the queue, not counted in orderCount
+        std::uint32_t deadOrders = 0;
+        // Tree of the level in positions, only with trackQueuePositions
+        std::uint32_t positionTree = QueuePositions::noTree;
+    };
+
+    using BidLevels = LevelPolicy<std::greater<Price>, Level>;
+    using AskLevels = LevelPolicy<std::less<Price>, Level>;
+
+    template<typename Trades>
+    OrderRef matchOrder(Order &order, Trades &trades);
+
+    template<typename Levels, typename Trades>
+    void matchAgainst(Order &order, Levels &levels, Trades &trades);
+
+    template<typename Levels>
+    OrderRef restOrder(const Order &order, Levels &levels);
+
+    template<typename Levels>
+    void unlinkOrder(Levels &levels, Price price, OrderHandle handle);
+
+    void cancel(OrderHandle handle);
+
+    template<typename Levels>
+    void reduce(Levels &levels, Price price, OrderHandle handle, Quantity quantity);
+
+    // Writes a record about the resting order to the event ring, if there is one
+    void publishEvent(BookEventType type, OrderHandle handle, Quantity quantity);
+
+    // Called at the end of every call that may have changed the book, stores the top of the book when it differs
+    // from what was stored last
+    void publishTopOfBook();
+
+    // Price and quantity of the best level that holds live orders, zero when there is none
+    template<typename Levels>
+    static void bestLevel(const Levels &levels, Price &price, std::uint64_t &quantity);
+
+    // Gives a newly queued order its ticket in the level's position tree
+    void trackPosition(Level &level, OrderHandle handle);
+
+    // Called right before the level is erased
+    void releaseLevel(const Level &level);
+
+    // Called after the totals of the level at price changed
+    template<typename Levels>
+    void recordLevelUpdate(const Levels &levels, Price price, const Level &level);
 
-    // Lookup table to find orders by their ID, for efficient removal O(1) compared to O(n)
-    std::unordered_map<OrderId, std::list<Order>::iterator> orderIdLookup;
+    template<typename Levels>
+    void compactLevels(Levels &levels);
+
+    // Unlinks the lazily cancelled orders of one level, and erases the level when nothing else is left
+    template<typename Levels>
+    void compactLevel(Levels &levels, Price price);
+
+    template<typename Result, typename Levels>
+    Result copyLevels(const Levels &levels) const;
+
+    template<typename Levels>
+    std::size_t collectDepth(const Levels &book, PriceLevel *levels, std::size_t maxLevels) const;
+
+    template<typename Levels>
+    PriceLevel findLevel(const Levels &levels, Price price) const;
+
+    DepthIndex<std::greater<Price> > &depthIndexOf(const BidLevels &) { return bidDepth; }
+    DepthIndex<std::less<Price> > &depthIndexOf(const AskLevels &) { return askDepth; }
+    const DepthIndex<std::greater<Price> > &depthIndexOf(const BidLevels &) const { return bidDepth; }
+    const DepthIndex<std::less<Price> > &depthIndexOf(const AskLevels &) const { return askDepth; }
+
+    // Called after the level at price changed its quantity by delta, the level still exists
+    template<typename Levels>
+    void updateDepthIndex(const Levels &levels, Price price, std::uint64_t delta);
+
+    template<typename Levels>
+    std::uint64_t cumulativeQuantity(const Levels &levels, Price price) const;
+
+    template<typename Levels>
+    bool fillPrice(const Levels &levels, std::uint64_t quantity, Price &price) const;
+
+    template<typename Levels>
+    FillSimulation simulateAgainst(const Order &order, const Levels &levels, TradeRequest *fills,
+                                   std::size_t maxFills) const;
+
+    OrderBookConfig config;
+
+    // Declared before the containers, which allocate all of their nodes from the resource
+    std::unique_ptr<HugePageResource> hugePageResource;
+    std::unique_ptr<NodePool> pool;
+    std::pmr::memory_resource *resource;
+
+    // Every resting order, the queues refer to them by handle
+    OrderStore store;
+    QueuePolicy queues;
+
+    BidLevels bids;
+    AskLevels asks;
+    DepthIndex<std::greater<Price> > bidDepth;
+    DepthIndex<std::less<Price> > askDepth;
+    QueuePositions positions;
+
+    // Lookup table from client ids to references, only used at the API boundary. Fills and cancels by reference
+    // leave their entry behind: it is recognised as stale by its generation and erased once the slot is reused, so
+    // the table never holds more entries than the store has slots
+    std::pmr::unordered_map<OrderId, OrderRef> orderIdLookup;
+
+    std::size_t restingOrders = 0;
+    // Cancelled lazily but still linked into their queue, with their quantity set to zero
+    std::size_t deadOrders = 0;
+    // Scratch space for compact
+    std::pmr::vector<Price> compactPrices;
+    std::pmr::vector<LevelUpdate> levelUpdates;
+    std::uint64_t eventSequence = 0;
+    std::uint64_t droppedEvents = 0;
+    std::uint64_t rejectedOrders = 0;
+    TopOfBook publishedTop{};
+
+#ifdef ORDERBOOK_LATENCY_STATS
+    OrderBookLatencyStats latencyStats;
+#endif
 };
 
+using OrderBook = BasicOrderBook<PriceLadder, LinkedQueues>;
+using LadderListOrderBook = BasicOrderBook<PriceLadder, ListQueues>;
+using LadderSmallOrderBook = BasicOrderBook<PriceLadder, SmallVectorQueues>;
+using MapOrderBook = BasicOrderBook<MapLevels, LinkedQueues>;
+using MapListOrderBook = BasicOrderBook<MapLevels, ListQueues>;
+using MapSmallOrderBook = BasicOrderBook<MapLevels, SmallVectorQueues>;
+using BTreeOrderBook = BasicOrderBook<BTreeLevels, LinkedQueues>;
+using BTreeListOrderBook = BasicOrderBook<BTreeLevels, ListQueues>;
+using VectorOrderBook = BasicOrderBook<VectorLevels, LinkedQueues>;
+using VectorListOrderBook = BasicOrderBook<VectorLevels, ListQueues>;
+
+extern template class BasicOrderBook<PriceLadder, LinkedQueues>;
+extern template class BasicOrderBook<PriceLadder, ListQueues>;
+extern template class BasicOrderBook<PriceLadder, SmallVectorQueues>;
+extern template class BasicOrderBook<MapLevels, LinkedQueues>;
+extern template class BasicOrderBook<MapLevels, ListQueues>;
+extern template class BasicOrderBook<MapLevels, SmallVectorQueues>;
+extern template class BasicOrderBook<BTreeLevels, LinkedQueues>;
+extern template class BasicOrderBook<BTreeLevels, ListQueues>;
+extern template class BasicOrderBook<VectorLevels, LinkedQueues>;
+extern template class BasicOrderBook<VectorLevels, ListQueues>;
+
+// Calls visit.template operator()<Book>(name) for every instantiated combination, the default first and
+// MapListOrderBook, the layout the book started out with, last
+template<typename Visit>
+void forEachOrderBookBackend(Visit &&visit) {
+    visit.template operator()<OrderBook>("ladder_linked");
+    visit.template operator()<LadderListOrderBook>("ladder_list");
+    visit.template operator()<LadderSmallOrderBook>("ladder_small");
+    visit.template operator()<BTreeOrderBook>("btree_linked");
+    visit.template operator()<BTreeListOrderBook>("btree_list");
+    visit.template operator()<VectorOrderBook>("vector_linked");
+    visit.template operator()<VectorListOrderBook>("vector_list");
+    visit.template operator()<MapOrderBook>("map_linked");
+    visit.template operator()<MapSmallOrderBook>("map_small");
+    visit.template operator()<MapListOrderBook>("map_list");
+}
+
 #endif
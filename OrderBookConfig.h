@@ -0,0 +1,70 @@
+#ifndef ORDER_BOOK_CONFIG_H
+#define ORDER_BOOK_CONFIG_H
+#include "TradeRequest.h"
+#include <cstddef>
+#include <memory_resource>
+
+template<typename T>
+class SpscRing;
+struct BookEvent;
+template<typename T>
+class SeqLock;
+struct TopOfBook;
+
+
+// Capacity to reserve when the book is constructed. Once the book holds no more than these limits, addOrder and
+// removeOrder never allocate: every node they need was already created and recycled into the book's pool.
+// Zero means no reservation, the book then grows on demand
+struct OrderBookConfig {
+    std::size_t maxOrders = 0;
+    std::size_t maxLevels = 0; // Per side
+    std::size_t maxFillsPerCall = 0;
+
+    // Resource for every container in the book, e.g. a monotonic arena per backtest or a huge page backed
+    // resource. It must outlive the book. When null the book allocates from its own NodePool
+    std::pmr::memory_resource *memoryResource = nullptr;
+
+    // Back the book's own NodePool with 2MB pages (see HugePageResource), ignored when memoryResource is set
+    bool hugePages = false;
+
+    // Resting orders store their price as a 31 bit offset from this, so the book accepts prices in
+    // [basePrice, basePrice + maxPriceTicks]. The default covers prices up to 21,474,836.47
+    Price basePrice = 0;
+
+    // Ticks per side kept in the flat array around the best price (see PriceLadder), rounded up to a multiple of 64.
+    // Levels further away from the touch are kept in a map
+    std::size_t ladderTicks = 4096;
+
+    // Cancels only mark the order dead and leave it in its queue. Matching drops the dead orders it reaches and
+    // BasicOrderBook::compact removes the rest, which runs by itself once dead orders outnumber resting ones. A level
+    // is compacted by itself once its dead orders outnumber its live ones, so a queue never grows for more dead
+    // orders than it holds live ones. Dead orders keep their slot until then, so maxOrders has to cover twice the
+    // resting orders to stay allocation free
+    bool lazyCancels = false;
+
+    // Ticks per side covered by a Fenwick tree of level quantities (see DepthIndex), which answers cumulative
+    // quantity and fill price queries in O(log ticks) at the cost of an O(log ticks) update on every rest, fill and
+    // cancel. Zero leaves it out, the queries then walk the levels
+    std::size_t depthIndexTicks = 0;
+
+    // Keep the quantity ahead of every resting order in its queue (see QueuePositions), which makes
+    // BasicOrderBook::getQuantityAhead O(log orders) instead of a walk along the queue. Costs an O(log orders) update
+    // on every rest, fill and cancel, and a tree per level of up to twice its orders
+    bool trackQueuePositions = false;
+
+    // Record a LevelUpdate for every level an addOrder or removeOrder call changes (see
+    // BasicOrderBook::getLevelUpdates). Room for maxFillsPerCall + 1 of them is reserved, which covers any call
+    bool publishLevelUpdates = false;
+
+    // Ring the book writes a BookEvent to for every add, execution, reduction and cancel of a resting order (see
+    // BookEvents.h). It must outlive the book and be read by a single consumer. The book never waits for it: a record
+    // that finds the ring full is dropped and counted, the consumer sees the gap in the sequence numbers
+    SpscRing<BookEvent> *eventRing = nullptr;
+
+    // Best bid and offer for other threads of the process, stored after every addOrder, removeOrder or reduceOrder
+    // call that changed either price or quantity at the touch and left alone by every other call. It must outlive the
+    // book. Readers copy it out with SeqLock::load and never hold up the book
+    SeqLock<TopOfBook> *topOfBook = nullptr;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef ORDER_QUEUES_H
+#define ORDER_QUEUES_H
+#include "CompactOrder.h"
+#include <list>
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+
+// Queue policies decide how the resting orders of one price level are kept in time priority. A policy is an object
+// owned by the book that operates on the per level Queue values stored by the level policy:
+//
+//   using Queue                                 value stored per price level, default constructible
+//   Policy(OrderStore &, memory_resource *)
+//   void reserve(size_t orders)                 creates what maxOrders resting orders need up front
+//   bool empty(const Queue &) const
+//   OrderHandle front(const Queue &) const
+//   void pushBack(Queue &, OrderHandle)
+//   void popFront(Queue &)
+//   void remove(Queue &, OrderHandle)           any position, the order is known to rest in this queue
+//   void forEach(const Queue &, visit) const    visit(OrderHandle) front to back, until it returns false
+
+// FIFO linked through the prev/next handles of the resting orders themselves, a level only stores head and tail
+class LinkedQueues {
+public:
+    struct Queue {
+        OrderHandle head = nullOrderHandle;
+        OrderHandle tail = nullOrderHandle;
+    };
+
+    LinkedQueues(OrderStore &store, std::pmr::memory_resource *) : store(store) {
+    }
+
+    void reserve(std::size_t) {
+    }
+
+    bool empty(const Queue &queue) const { return queue.head == nullOrderHandle; }
+
+    OrderHandle front(const Queue &queue) const { return queue.head; }
+
+    void pushBack(Queue &queue, const OrderHandle handle) {
+        CompactOrder &order = store[handle];
+        order.prev = queue.tail;
+        order.next = nullOrderHandle;
+        if (queue.tail != nullOrderHandle) {
+            store[queue.tail].next = handle;
+        } else {
+            queue.head = handle;
+        }
+        queue.tail = handle;
+    }
+
+    void popFront(Queue &queue) { remove(queue, queue.head); }
+
+    void remove(Queue &queue, const OrderHandle handle) {
+        const CompactOrder &order = store[handle];
+        if (order.prev != nullOrderHandle) {
+            store[order.prev].next = order.next;
+        } else {
+            queue.head = order.next;
+        }
+        if (order.next != nullOrderHandle) {
+            store[order.next].prev = order.prev;
+        } else {
+            queue.tail = order.prev;
+        }
+    }
+
+    template<typename Visit>
+    void forEach(const Queue &queue, Visit &&visit) const {
+        for (OrderHandle handle = queue.head; handle != nullOrderHandle; handle = store[handle].next) {
+            if (!visit(handle)) return;
+        }
+    }
+
+private:
+    OrderStore &store;
+};
+
+// One std::list node per resting order, as the book was originally laid out. The position of every order in its list
+// is kept per handle so cancels stay O(1). Mostly useful as the reference the other policies are checked against
+class ListQueues {
+public:
+    using Queue = std::pmr::list<OrderHandle>;
+
+    ListQueues(OrderStore &, std::pmr::memory_resource *resource) : positions(resource), resource(resource) {
+    }
+
+    void reserve(const std::size_t orders) {
+        positions.reserve(orders);
+        // Creates the list nodes once so the pool keeps them on its free list
+        Queue nodes(orders, nullOrderHandle, resource);
+    }
+
+    bool empty(const Queue &queue) const { return queue.empty(); }
+
+    OrderHandle front(const Queue &queue) const { return queue.front(); }
+
+    void pushBack(Queue &queue, const OrderHandle handle) {
+        if (handle >= positions.size()) {
+            positions.resize(handle + 1);
+        }
+        positions[handle] = queue.insert(queue.end(), handle);
+    }
+
+    void popFront(Queue &queue) { queue.pop_front(); }
+
+    void remove(Queue &queue, const OrderHandle handle) { queue.erase(positions[handle]); }
+
+    template<typename Visit>
+    void forEach(const Queue &queue, Visit &&visit) const {
+        for (const OrderHandle handle: queue) {
+            if (!visit(handle)) return;
+        }
+    }
+
+private:
+    std::pmr::vector<Queue::iterator> positions;
+    std::pmr::memory_resource *resource;
+};
+
+// Contiguous slots per level, the first few inline in the level itself and a block from the book's resource once a
+// level outgrows them, so matching walks the front of one array. An order's slot index is kept in its prev field,
+// which makes a cancel O(1): the slot becomes a tombstone (nullOrderHandle) and the head skips over it. Tombstones
+// are squeezed out when the array is full, and the block grows only when more than half of it is live. A level that
+// empties drops its block and starts over inline
+class SmallVectorQueues {
+public:
+    static constexpr std::uint32_t inlineCapacity = 8;
+
+    class Queue {
+    public:
+        Queue() = default;
+
+        Queue(Queue &&other) noexcept { take(other); }
+
+        Queue &operator=(Queue &&other) noexcept {
+            if (this != &other) {
+                release();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~Queue() { release(); }
+
+        OrderHandle *slots() { return spill != nullptr ? spill : inlineSlots; }
+        const OrderHandle *slots() const { return spill != nullptr ? spill : inlineSlots; }
+
+    private:
+        friend class SmallVectorQueues;
+
+        void release() {
+            if (spill != nullptr) {
+                resource->deallocate(spill, capacity * sizeof(OrderHandle), alignof(OrderHandle));
+                spill = nullptr;
+            }
+            head = tail = live = 0;
+            capacity = inlineCapacity;
+        }
+
+        void take(Queue &other) {
+            spill = std::exchange(other.spill, nullptr);
+            resource = other.resource;
+            head = other.head;
+            tail = other.tail;
+            live = other.live;
+            capacity = other.capacity;
+            if (spill == nullptr) {
+                std::copy(other.inlineSlots + head, other.inlineSlots + tail, inlineSlots + head);
+            }
+            other.release();
+        }
+
+        OrderHandle *spill = nullptr;
+        std::pmr::memory_resource *resource = nullptr;
+        // Slots in [head, tail) are orders or tombstones, head is always a live order unless the queue is empty
+        std::uint32_t head = 0;
+        std::uint32_t tail = 0;
+        std::uint32_t live = 0;
+        std::uint32_t capacity = inlineCapacity;
+        OrderHandle inlineSlots[inlineCapacity];
+    };
+
+    SmallVectorQueues(OrderStore &store, std::pmr::memory_resource *resource) : store(store), resource(resource) {
+    }
+
+    // Cycles the first spill block of every level that could outgrow its inline slots through the resource, so a
+    // pool keeps them on its free list
+    void reserve(const std::size_t orders) {
+        std::pmr::vector<OrderHandle *> blocks(resource);
+        blocks.reserve(orders / (inlineCapacity + 1));
+        for (std::size_t i = 0; i < orders / (inlineCapacity + 1); ++i) {
+            blocks.push_back(static_cast<OrderHandle *>(resource->allocate(2 * inlineCapacity * sizeof(OrderHandle),
+                                                                           alignof(OrderHandle))));
+        }
+        for (OrderHandle *block: blocks) {
+            resource->deallocate(block, 2 * inlineCapacity * sizeof(OrderHandle), alignof(OrderHandle));
+        }
+    }
+
+    bool empty(const Queue &queue) const { return queue.live == 0; }
+
+    OrderHandle front(const Queue &queue) const { return queue.slots()[queue.head]; }
+
+    void pushBack(Queue &queue, const OrderHandle handle) {
+        if (queue.tail == queue.capacity) {
+            makeRoom(queue);
+        }
+        queue.slots()[queue.tail] = handle;
+        store[handle].prev = queue.tail++;
+        ++queue.live;
+    }
+
+    // Matching drains levels through here, the head slot is simply skipped instead of being looked up
+    void popFront(Queue &queue) {
+        if (--queue.live == 0) {
+            queue.release();
+            return;
+        }
+        const OrderHandle *slots = queue.slots();
+        do {
+            ++queue.head;
+        } while (slots[queue.head] == nullOrderHandle);
+    }
+
+    void remove(Queue &queue, const OrderHandle handle) {
+        if (--queue.live == 0) {
+            queue.release();
+            return;
+        }
+        OrderHandle *slots = queue.slots();
+        slots[store[handle].prev] = nullOrderHandle;
+        while (slots[queue.head] == nullOrderHandle) ++queue.head;
+        while (slots[queue.tail - 1] == nullOrderHandle) --queue.tail;
+    }
+
+    template<typename Visit>
+    void forEach(const Queue &queue, Visit &&visit) const {
+        const OrderHandle *slots = queue.slots();
+        for (std::uint32_t i = queue.head; i < queue.tail; ++i) {
+            if (slots[i] != nullOrderHandle && !visit(slots[i])) return;
+        }
+    }
+
+private:
+    // Called with the array full: squeezes the tombstones out, into a block twice the size when that would leave
+    // less than half of it free
+    void makeRoom(Queue &queue) {
+        OrderHandle *from = queue.slots();
+        OrderHandle *to = from;
+        const bool grow = queue.live > queue.capacity / 2;
+        if (grow) {
+            to = static_cast<OrderHandle *>(resource->allocate(2 * queue.capacity * sizeof(OrderHandle),
+                                                               alignof(OrderHandle)));
+        }
+
+        std::uint32_t count = 0;
+        for (std::uint32_t i = queue.head; i < queue.tail; ++i) {
+            if (from[i] == nullOrderHandle) continue;
+            to[count] = from[i];
+            store[from[i]].prev = count++;
+        }
+
+        if (grow) {
+            if (queue.spill != nullptr) {
+                resource->deallocate(queue.spill, queue.capacity * sizeof(OrderHandle), alignof(OrderHandle));
+            }
+            queue.spill = to;
+            queue.resource = resource;
+            queue.capacity *= 2;
+        }
+        queue.head = 0;
+        queue.tail = count;
+    }
+
+    OrderStore &store;
+    std::pmr::memory_resource *resource;
+};
+
+#endif
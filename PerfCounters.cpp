@@ -0,0 +1,139 @@
+#include "PerfCounters.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+    const char *eventNames[perfEventCount] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"
+    };
+
+#ifdef __linux__
+    constexpr std::uint64_t cacheEvent(const std::uint64_t cache, const std::uint64_t operation,
+                                       const std::uint64_t result) {
+        return cache | (operation << 8) | (result << 16);
+    }
+
+    struct EventConfig {
+        std::uint32_t type;
+        std::uint64_t config;
+    };
+
+    const EventConfig eventConfigs[perfEventCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {
+            PERF_TYPE_HW_CACHE,
+            cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)
+        },
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {
+            PERF_TYPE_HW_CACHE,
+            cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)
+        },
+    };
+
+    int openEvent(const EventConfig &event, const int groupFd) {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = event.type;
+        attributes.config = event.config;
+        attributes.disabled = groupFd == -1 ? 1 : 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, 0));
+    }
+#endif
+}
+
+const char *perfEventName(const PerfEvent event) {
+    return eventNames[static_cast<std::size_t>(event)];
+}
+
+PerfCounts &PerfCounts::operator+=(const PerfCounts &other) {
+    for (std::size_t i = 0; i < perfEventCount; ++i) {
+        values[i] += other.values[i];
+        valid[i] = valid[i] && other.valid[i];
+    }
+    return *this;
+}
+
+PerfCounterGroup::PerfCounterGroup() {
+    for (std::size_t i = 0; i < perfEventCount; ++i) {
+        fds[i] = -1;
+        readIndex[i] = -1;
+    }
+
+#ifdef __linux__
+    // Cycles lead the group, the remaining events are optional members
+    for (std::size_t i = 0; i < perfEventCount; ++i) {
+        fds[i] = openEvent(eventConfigs[i], leaderFd);
+        if (fds[i] < 0) {
+            if (i == 0) {
+                openError = std::string("perf_event_open failed: ") + std::strerror(errno);
+                return;
+            }
+            continue;
+        }
+        if (i == 0) leaderFd = fds[i];
+        readIndex[i] = openedCount++;
+    }
+#else
+    openError = "hardware counters are only supported on Linux";
+#endif
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+#ifdef __linux__
+    for (const int fd: fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+void PerfCounterGroup::start() {
+#ifdef __linux__
+    if (!available()) return;
+    ioctl(leaderFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void PerfCounterGroup::stop() {
+#ifdef __linux__
+    if (!available()) return;
+    ioctl(leaderFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+PerfCounts PerfCounterGroup::read() const {
+    PerfCounts counts;
+#ifdef __linux__
+    if (!available()) return counts;
+
+    // Layout of a PERF_FORMAT_GROUP read: nr, time_enabled, time_running, then one value per event
+    std::uint64_t buffer[3 + perfEventCount]{};
+    if (::read(leaderFd, buffer, sizeof(buffer)) < static_cast<ssize_t>(3 * sizeof(std::uint64_t))) return counts;
+
+    const std::uint64_t enabled = buffer[1];
+    const std::uint64_t running = buffer[2];
+    const double scale = running == 0 ? 0 : static_cast<double>(enabled) / static_cast<double>(running);
+
+    for (std::size_t i = 0; i < perfEventCount; ++i) {
+        if (readIndex[i] < 0 || static_cast<std::uint64_t>(readIndex[i]) >= buffer[0]) continue;
+        counts.values[i] = static_cast<std::uint64_t>(static_cast<double>(buffer[3 + readIndex[i]]) * scale);
+        counts.valid[i] = running > 0 || enabled == 0;
+    }
+#endif
+    return counts;
+}
@@ -0,0 +1,51 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <cstdint>
+#include <string>
+
+
+enum class PerfEvent { Cycles, Instructions, L1DMisses, LLCMisses, BranchMisses, DTLBMisses, Count };
+
+constexpr std::size_t perfEventCount = static_cast<std::size_t>(PerfEvent::Count);
+
+const char *perfEventName(PerfEvent event);
+
+struct PerfCounts {
+    std::uint64_t values[perfEventCount]{};
+    bool valid[perfEventCount]{};
+
+    PerfCounts &operator+=(const PerfCounts &other);
+};
+
+// A group of hardware counters for the calling thread, opened with perf_event_open and counting user space only.
+// Events the host does not support (common in VMs and containers) are skipped, and when the syscall is not
+// permitted at all available() returns false and every reading comes back invalid
+class PerfCounterGroup {
+public:
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+
+    PerfCounterGroup(const PerfCounterGroup &) = delete;
+    PerfCounterGroup &operator=(const PerfCounterGroup &) = delete;
+
+    bool available() const { return leaderFd >= 0; }
+
+    // Why the group could not be opened, empty when it could
+    const std::string &error() const { return openError; }
+
+    void start();
+    void stop();
+
+    // Counts accumulated between the last start() and stop(), scaled up when the kernel had to multiplex
+    PerfCounts read() const;
+
+private:
+    int leaderFd = -1;
+    int fds[perfEventCount];
+    // Position of each event in the group read, -1 when it could not be opened
+    int readIndex[perfEventCount];
+    int openedCount = 0;
+    std::string openError;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef PRICE_LADDER_H
+#define PRICE_LADDER_H
+#include "OrderBookConfig.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Level policy (see MapLevels.h) for books where nearly all activity is close to the touch. A window of consecutive
+// ticks around the best price is a flat array of queues indexed by price - windowBase, with a two level occupancy
+// bitset (one bit per tick, one bit per non-empty bitset word) to find the next best level in a few instructions.
+// Levels outside the window live in a sorted map.
+//
+// The window always holds the best level: a level that would become the best outside of it, or the window running
+// empty while the map still holds levels, recenters the window on that price. The map therefore only ever holds
+// levels worse than the window, which is where resting orders that rarely trade accumulate
+template<typename Compare, typename Level>
+class PriceLadder {
+public:
+    static constexpr bool highestFirst = std::is_same_v<Compare, std::greater<Price> >;
+
+    PriceLadder(const OrderBookConfig &config, std::pmr::memory_resource *resource)
+        : ticks((std::max<std::size_t>(config.ladderTicks, 64) + 63) / 64 * 64),
+          queues(ticks, resource),
+          levelBits(ticks / 64, 0, resource),
+          wordBits((ticks / 64 + 63) / 64, 0, resource),
+          outliers(resource) {
+    }
+
+    // Creates and releases the map nodes for this many levels, recentering moves window levels through the map
+    void reserve(const std::size_t levels) {
+        for (std::size_t i = 0; i < levels; ++i) {
+            outliers.try_emplace(i);
+        }
+        outliers.clear();
+    }
+
+    static bool better(const Price price, const Price other) { return Compare()(price, other); }
+
+    bool empty() const { return windowLevels == 0; }
+
+    std::size_t size() const { return windowLevels + outliers.size(); }
+
+    Price bestPrice() const { return windowBase + bestIndex; }
+
+    Level &bestQueue() { return queues[bestIndex]; }
+
+    void eraseBest() { eraseIndex(bestIndex); }
+
+    // Level at price, an empty one is created if it does not exist yet
+    Level &operator[](const Price price) {
+        if (!inWindow(price)) {
+            if (windowLevels != 0 && !better(price, bestPrice())) {
+                return outliers[price];
+            }
+            recenter(price);
+        }
+
+        const std::size_t index = price - windowBase;
+        if (!testBit(index)) {
+            setBit(index);
+            queues[index] = Level();
+            if (++windowLevels == 1 || better(price, bestPrice())) {
+                bestIndex = index;
+            }
+        }
+        return queues[index];
+    }
+
+    Level *find(const Price price) {
+        if (inWindow(price)) {
+            const std::size_t index = price - windowBase;
+            return testBit(index) ? &queues[index] : nullptr;
+        }
+        const auto level = outliers.find(price);
+        return level == outliers.end() ? nullptr : &level->second;
+    }
+
+    const Level *find(const Price price) const {
+        if (inWindow(price)) {
+            const std::size_t index = price - windowBase;
+            return testBit(index) ? &queues[index] : nullptr;
+        }
+        const auto level = outliers.find(price);
+        return level == outliers.end() ? nullptr : &level->second;
+    }
+
+    void erase(const Price price) {
+        if (inWindow(price)) {
+            eraseIndex(price - windowBase);
+        } else {
+            outliers.erase(price);
+        }
+    }
+
+    // Calls visit(price, queue) for every level, best price first, until it returns false
+    template<typename Visit>
+    void forEachLevel(Visit &&visit) const {
+        for (std::size_t index = windowLevels != 0 ? bestIndex : ticks; index != ticks; index = nextLevel(index)) {
+            if (!visit(windowBase + index, queues[index])) return;
+        }
+        for (const auto &[price, queue]: outliers) {
+            if (!visit(price, queue)) return;
+        }
+    }
+
+private:
+    // Occupied tick following index in best first order, ticks when index holds the worst level of the window
+    std::size_t nextLevel(const std::size_t index) const {
+        std::size_t word = index / 64;
+        std::uint64_t bits = levelBits[word] & (highestFirst
+                                                    ? (std::uint64_t{1} << index % 64) - 1
+                                                    : ~std::uint64_t{1} << index % 64);
+        if (bits == 0) {
+            std::size_t summary = word / 64;
+            std::uint64_t words = wordBits[summary] & (highestFirst
+                                                           ? (std::uint64_t{1} << word % 64) - 1
+                                                           : ~std::uint64_t{1} << word % 64);
+            while (words == 0) {
+                if (highestFirst ? summary == 0 : summary + 1 == wordBits.size()) return ticks;
+                summary += highestFirst ? -1 : 1;
+                words = wordBits[summary];
+            }
+            word = summary * 64 + (highestFirst ? 63 - std::countl_zero(words) : std::countr_zero(words));
+            bits = levelBits[word];
+        }
+        return word * 64 + (highestFirst ? 63 - std::countl_zero(bits) : std::countr_zero(bits));
+    }
+
+    bool inWindow(const Price price) const { return price >= windowBase && price - windowBase < ticks; }
+
+    bool testBit(const std::size_t index) const { return levelBits[index / 64] >> index % 64 & 1; }
+
+    void setBit(const std::size_t index) {
+        levelBits[index / 64] |= std::uint64_t{1} << index % 64;
+        wordBits[index / 4096] |= std::uint64_t{1} << index / 64 % 64;
+    }
+
+    void clearBit(const std::size_t index) {
+        levelBits[index / 64] &= ~(std::uint64_t{1} << index % 64);
+        if (levelBits[index / 64] == 0) {
+            wordBits[index / 4096] &= ~(std::uint64_t{1} << index / 64 % 64);
+        }
+    }
+
+    // Index of the best occupied tick, only meaningful when the window holds a level
+    std::size_t scanBest() const {
+        if constexpr (highestFirst) {
+            for (std::size_t summary = wordBits.size(); summary-- > 0;) {
+                if (wordBits[summary] != 0) {
+                    const std::size_t word = summary * 64 + 63 - std::countl_zero(wordBits[summary]);
+                    return word * 64 + 63 - std::countl_zero(levelBits[word]);
+                }
+            }
+        } else {
+            for (std::size_t summary = 0; summary < wordBits.size(); ++summary) {
+                if (wordBits[summary] != 0) {
+                    const std::size_t word = summary * 64 + std::countr_zero(wordBits[summary]);
+                    return word * 64 + std::countr_zero(levelBits[word]);
+                }
+            }
+        }
+        return 0;
+    }
+
+    void eraseIndex(const std::size_t index) {
+        clearBit(index);
+        if (--windowLevels == 0) {
+            if (!outliers.empty()) {
+                recenter(outliers.begin()->first);
+            }
+        } else if (index == bestIndex) {
+            bestIndex = scanBest();
+        }
+    }
+
+    // Centers the window on price, the new best level. Every window level goes through the map, which only costs
+    // in proportion to the levels involved and happens when the market moved by half the window
+    void recenter(const Price price) {
+        for (std::size_t word = 0; word < levelBits.size(); ++word) {
+            for (std::uint64_t bits = levelBits[word]; bits != 0; bits &= bits - 1) {
+                const std::size_t index = word * 64 + std::countr_zero(bits);
+                outliers.emplace(windowBase + index, std::move(queues[index]));
+            }
+            levelBits[word] = 0;
+        }
+        std::fill(wordBits.begin(), wordBits.end(), 0);
+        windowLevels = 0;
+        windowBase = price > ticks / 2 ? price - ticks / 2 : 0;
+
+        // Every level in the map is worse than price, so the ones that fit the new window come first
+        auto level = outliers.begin();
+        for (; level != outliers.end() && inWindow(level->first); ++level) {
+            const std::size_t index = level->first - windowBase;
+            setBit(index);
+            queues[index] = std::move(level->second);
+            ++windowLevels;
+        }
+        outliers.erase(outliers.begin(), level);
+
+        if (windowLevels != 0) {
+            bestIndex = scanBest();
+        }
+    }
+
+    std::size_t ticks;
+    std::pmr::vector<Level> queues;
+    std::pmr::vector<std::uint64_t> levelBits;
+    std::pmr::vector<std::uint64_t> wordBits;
+    std::pmr::map<Price, Level, Compare> outliers;
+    Price windowBase = 0;
+    std::size_t windowLevels = 0;
+    std::size_t bestIndex = 0;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef QUEUE_POSITIONS_H
+#define QUEUE_POSITIONS_H
+#include "CompactOrder.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+
+// Quantity ahead of every resting order in its queue (see OrderBookConfig::trackQueuePositions). Each level that
+// holds orders owns one tree out of a pool, a Fenwick tree of order quantities indexed by a ticket the level hands
+// out in arrival order, so the quantity ahead of an order is the prefix sum up to its ticket. Fills, cancels
+// anywhere in the queue and the query are O(log orders).
+//
+// Tickets are not reused while the level exists. When they run out the book renumbers the orders still queued
+// through rebuild, into a tree twice the size when more than half of them are live. Trees released with their level
+// keep their storage for the next level
+class QueuePositions {
+public:
+    static constexpr std::uint32_t noTree = UINT32_MAX;
+
+    explicit QueuePositions(std::pmr::memory_resource *resource)
+        : trees(resource), freeTrees(resource), positions(resource) {
+    }
+
+    void reserve(const std::size_t orders, const std::size_t levels) {
+        positions.reserve(orders);
+        trees.reserve(levels);
+        freeTrees.reserve(levels);
+    }
+
+    std::uint32_t acquire() {
+        if (freeTrees.empty()) {
+            trees.emplace_back(trees.get_allocator().resource());
+            return static_cast<std::uint32_t>(trees.size() - 1);
+        }
+        const std::uint32_t tree = freeTrees.back();
+        freeTrees.pop_back();
+        return tree;
+    }
+
+    // Every order pushed was reduced by all of its quantity by the time its level goes away, so the sums are back to
+    // zero already
+    void release(const std::uint32_t tree) {
+        trees[tree].nextTicket = 0;
+        freeTrees.push_back(tree);
+    }
+
+    // Whether push needs a rebuild first
+    bool full(const std::uint32_t tree) const {
+        const Tree &target = trees[tree];
+        return target.nextTicket + 1 >= target.sums.size();
+    }
+
+    void push(const std::uint32_t tree, const OrderHandle handle, const std::uint64_t quantity) {
+        if (handle >= positions.size()) {
+            positions.resize(handle + 1);
+        }
+        Tree &target = trees[tree];
+        positions[handle] = Position{tree, target.nextTicket};
+        add(target, target.nextTicket++, quantity);
+    }
+
+    // The order traded or was cancelled, quantity is what it lost
+    void reduce(const OrderHandle handle, const std::uint64_t quantity) {
+        const Position position = positions[handle];
+        add(trees[position.tree], position.ticket, -quantity);
+    }
+
+    // Quantity resting in front of the order in its queue
+    std::uint64_t ahead(const OrderHandle handle) const {
+        const Position position = positions[handle];
+        const auto &sums = trees[position.tree].sums;
+        std::uint64_t sum = 0;
+        for (std::size_t i = position.ticket; i > 0; i -= i & -i) {
+            sum += sums[i];
+        }
+        return sum;
+    }
+
+    // Hands out new tickets to the queued orders, front to back. forEach(visit) calls visit(handle, quantity) for
+    // each of them, count is how many there are
+    template<typename ForEach>
+    void rebuild(const std::uint32_t tree, const std::size_t count, ForEach &&forEach) {
+        Tree &target = trees[tree];
+        const std::size_t size = std::max<std::size_t>(std::bit_ceil(2 * count + 2), 16);
+        if (target.sums.size() < size) {
+            target.sums.resize(size);
+        }
+        std::fill(target.sums.begin(), target.sums.end(), 0);
+        target.nextTicket = 0;
+        forEach([&](const OrderHandle handle, const std::uint64_t quantity) {
+            positions[handle].ticket = target.nextTicket;
+            target.sums[++target.nextTicket] = quantity;
+        });
+
+        // Linear construction, every node passes its sum on to its parent
+        for (std::size_t i = 1; i < target.sums.size(); ++i) {
+            const std::size_t parent = i + (i & -i);
+            if (parent < target.sums.size()) target.sums[parent] += target.sums[i];
+        }
+    }
+
+private:
+    struct Tree {
+        explicit Tree(std::pmr::memory_resource *resource) : sums(resource) {
+        }
+
+        // 1-based Fenwick tree, the order with ticket t is at t + 1
+        std::pmr::vector<std::uint64_t> sums;
+        std::uint32_t nextTicket = 0;
+    };
+
+    struct Position {
+        std::uint32_t tree;
+        std::uint32_t ticket;
+    };
+
+    static void add(Tree &tree, const std::uint32_t ticket, const std::uint64_t delta) {
+        for (std::size_t i = ticket + 1; i < tree.sums.size(); i += i & -i) {
+            tree.sums[i] += delta;
+        }
+    }
+
+    std::pmr::vector<Tree> trees;
+    std::pmr::vector<std::uint32_t> freeTrees;
+    std::pmr::vector<Position> positions;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+// One writer publishes a trivially copyable value that any number of readers copy out without ever making the writer
+// wait. The sequence is odd while a store is under way; a reader copies the value between two reads of it and tries
+// again when they differ. The value is copied as relaxed atomic words, so a torn copy is thrown away rather than
+// being a data race, and everything is address free: it works the same in memory shared between processes
+template<typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) % sizeof(std::uint64_t) == 0);
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+public:
+    // Writer side, from one thread at a time
+    void store(const T &value) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(&value);
+        const std::uint64_t position = sequence.load(std::memory_order_relaxed);
+        sequence.store(position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < wordCount; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+            words[i].store(word, std::memory_order_relaxed);
+        }
+        sequence.store(position + 2, std::memory_order_release);
+    }
+
+    // False when a store was under way or completed during the copy, value is left alone then
+    bool tryLoad(T &value) const {
+        const std::uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) return false;
+        std::uint64_t buffer[wordCount];
+        for (std::size_t i = 0; i < wordCount; ++i) {
+            buffer[i] = words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != before) return false;
+        std::memcpy(&value, buffer, sizeof(T));
+        return true;
+    }
+
+    // Retries until a copy is consistent, only a writer that stopped half way through a store keeps it spinning
+    T load() const {
+        T value{};
+        while (!tryLoad(value)) {
+        }
+        return value;
+    }
+
+    // Stores completed so far
+    std::uint64_t version() const { return sequence.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr std::size_t wordCount = sizeof(T) / sizeof(std::uint64_t);
+
+    alignas(64) std::atomic<std::uint64_t> sequence{0};
+    std::atomic<std::uint64_t> words[wordCount]{};
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "SharedMarketData.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+    std::string objectPath(const std::string &name) {
+        return name.starts_with('/') ? name : '/' + name;
+    }
+
+    std::uint64_t now() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+MarketDataPublisher::MarketDataPublisher(const std::string &name, const bool replace) : objectName(objectPath(name)) {
+#ifdef __linux__
+    if (replace) shm_unlink(objectName.c_str());
+    const int fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        const int error = errno;
+        openError = "shm_open " + objectName + ": " + std::strerror(error);
+        if (error == EEXIST) openError += ", another publisher owns it or one left it behind";
+        return;
+    }
+    if (ftruncate(fd, sizeof(SharedMarketDataSegment)) != 0) {
+        openError = "ftruncate " + objectName + ": " + std::strerror(errno);
+        close(fd);
+        shm_unlink(objectName.c_str());
+        return;
+    }
+    void *mapping = mmap(nullptr, sizeof(SharedMarketDataSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        openError = "mmap " + objectName + ": " + std::strerror(errno);
+        shm_unlink(objectName.c_str());
+        return;
+    }
+
+    // The object is new and zero filled. A reader that maps it early sees no magic until the rest is in place
+    segment = new(mapping) SharedMarketDataSegment{};
+    segment->layoutVersion = SharedMarketDataSegment::expectedLayoutVersion;
+    segment->depthLevels = sharedDepthLevels;
+    segment->magic.store(SharedMarketDataSegment::expectedMagic, std::memory_order_release);
+#else
+    static_cast<void>(replace);
+    openError = "shared memory market data needs POSIX shared memory";
+#endif
+}
+
+MarketDataPublisher::~MarketDataPublisher() {
+#ifdef __linux__
+    if (segment != nullptr) {
+        munmap(segment, sizeof(SharedMarketDataSegment));
+        shm_unlink(objectName.c_str());
+    }
+#endif
+}
+
+void MarketDataPublisher::store() {
+    current.publishedAt = now();
+    segment->snapshot.store(current);
+    ++current.sequence;
+}
+
+MarketDataReader::MarketDataReader(const std::string &name) {
+#ifdef __linux__
+    const std::string path = objectPath(name);
+    const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        openError = "shm_open " + path + ": " + std::strerror(errno);
+        return;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(SharedMarketDataSegment)) {
+        openError = path + " is not a market data segment";
+        close(fd);
+        return;
+    }
+    void *mapping = mmap(nullptr, sizeof(SharedMarketDataSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        openError = "mmap " + path + ": " + std::strerror(errno);
+        return;
+    }
+
+    const auto *mapped = static_cast<const SharedMarketDataSegment *>(mapping);
+    if (mapped->magic.load(std::memory_order_acquire) != SharedMarketDataSegment::expectedMagic ||
+        mapped->layoutVersion != SharedMarketDataSegment::expectedLayoutVersion ||
+        mapped->depthLevels != sharedDepthLevels) {
+        openError = path + " has a different layout or is not set up yet";
+        munmap(mapping, sizeof(SharedMarketDataSegment));
+        return;
+    }
+    segment = mapped;
+#else
+    openError = "shared memory market data needs POSIX shared memory";
+#endif
+}
+
+MarketDataReader::~MarketDataReader() {
+#ifdef __linux__
+    if (segment != nullptr) {
+        munmap(const_cast<SharedMarketDataSegment *>(segment), sizeof(SharedMarketDataSegment));
+    }
+#endif
+}
+
+bool MarketDataReader::read(DepthSnapshot &snapshot, const std::size_t maxAttempts) const {
+    if (segment == nullptr || segment->snapshot.version() == 0) return false;
+    for (std::size_t attempt = 0; attempt < maxAttempts; ++attempt) {
+        if (segment->snapshot.tryLoad(snapshot)) return true;
+    }
+    return false;
+}
+
+std::chrono::nanoseconds MarketDataReader::age(const DepthSnapshot &snapshot) {
+    return std::chrono::nanoseconds(static_cast<std::int64_t>(now() - snapshot.publishedAt));
+}
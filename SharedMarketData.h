@@ -0,0 +1,161 @@
+#ifndef SHARED_MARKET_DATA_H
+#define SHARED_MARKET_DATA_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "OrderBook.h"
+#include "SeqLock.h"
+
+
+// Levels per side the shared snapshot has room for
+constexpr std::size_t sharedDepthLevels = 10;
+
+// Best bid and offer are bids[0] and asks[0] when the counts are not zero
+struct DepthSnapshot {
+    std::uint64_t sequence; // Snapshots published before this one, 0 for the first
+    std::uint64_t publishedAt; // steady_clock nanoseconds, CLOCK_MONOTONIC on Linux, which all processes share
+    std::uint32_t bidLevels;
+    std::uint32_t askLevels;
+    PriceLevel bids[sharedDepthLevels];
+    PriceLevel asks[sharedDepthLevels];
+};
+
+// What lives in the shared memory object. Readers check magic and layoutVersion before they trust the rest
+struct SharedMarketDataSegment {
+    static constexpr std::uint64_t expectedMagic = 0x4f424d4b54444154; // "OBMKTDAT"
+    static constexpr std::uint32_t expectedLayoutVersion = 1;
+
+    std::atomic<std::uint64_t> magic;
+    std::uint32_t layoutVersion;
+    std::uint32_t depthLevels;
+    SeqLock<DepthSnapshot> snapshot;
+};
+
+// Writes the top of the book into a POSIX shared memory object (shm_open) for readers in other processes on the same
+// host, see MarketDataReader. Publishing is a seqlock store of one DepthSnapshot, it never waits for a reader. The
+// publisher creates the object exclusively and unlinks it on destruction, it never sets up a segment over one that
+// readers may have mapped. When it can not be set up available() returns false and publishing does nothing. Not
+// thread safe, it belongs to the thread that runs the book
+class MarketDataPublisher {
+public:
+    // name is the shared memory object, e.g. "/orderbook", a leading slash is added when it is missing. An object
+    // that already exists, from another publisher or one that died, is an error unless replace is set, which unlinks
+    // it first: readers that still have it mapped keep the old object and stop seeing updates
+    explicit MarketDataPublisher(const std::string &name, bool replace = false);
+    ~MarketDataPublisher();
+
+    MarketDataPublisher(const MarketDataPublisher &) = delete;
+    MarketDataPublisher &operator=(const MarketDataPublisher &) = delete;
+
+    bool available() const { return segment != nullptr; }
+
+    // Why the object could not be set up, empty when it could
+    const std::string &error() const { return openError; }
+
+    // Snapshots published so far
+    std::uint64_t published() const { return current.sequence; }
+
+    // Publishes the current top of the book
+    template<typename Book>
+    void publish(const Book &book) {
+        if (segment == nullptr) return;
+        current.bidLevels = static_cast<std::uint32_t>(book.getDepth(Side::Buy, current.bids, sharedDepthLevels));
+        current.askLevels = static_cast<std::uint32_t>(book.getDepth(Side::Sell, current.asks, sharedDepthLevels));
+        primed = true;
+        store();
+    }
+
+    // Publishes only when the last addOrder, removeOrder or reduceOrder call changed a level within the published
+    // depth, which needs OrderBookConfig::publishLevelUpdates. The published levels are edited with the updates, the
+    // book is only asked again for a side whose full set of levels lost one. True when it published
+    template<typename Book>
+    bool publishChanges(const Book &book) {
+        if (segment == nullptr) return false;
+        if (!primed) {
+            publish(book);
+            return true;
+        }
+        bool changed = false;
+        bool refillBids = false;
+        bool refillAsks = false;
+        for (const LevelUpdate &update: book.getLevelUpdates()) {
+            changed = (update.side == Side::Buy
+                           ? edit(current.bids, current.bidLevels, update, true, refillBids)
+                           : edit(current.asks, current.askLevels, update, false, refillAsks)) || changed;
+        }
+        if (!changed) return false;
+        if (refillBids) {
+            current.bidLevels = static_cast<std::uint32_t>(book.getDepth(Side::Buy, current.bids, sharedDepthLevels));
+        }
+        if (refillAsks) {
+            current.askLevels = static_cast<std::uint32_t>(book.getDepth(Side::Sell, current.asks, sharedDepthLevels));
+        }
+        store();
+        return true;
+    }
+
+private:
+    // Applies a level update to the published levels of one side, false when it lies beyond them. Sets refill when
+    // a full set lost a level, the next one down is only known to the book
+    static bool edit(PriceLevel *levels, std::uint32_t &count, const LevelUpdate &update, const bool bids,
+                     bool &refill) {
+        const auto better = [bids](const Price a, const Price b) { return bids ? a > b : a < b; };
+        if (count == sharedDepthLevels && better(levels[count - 1].price, update.price)) return false;
+        std::uint32_t index = 0;
+        while (index < count && better(levels[index].price, update.price)) ++index;
+        const bool present = index < count && levels[index].price == update.price;
+        if (update.orderCount == 0) {
+            if (!present) return false;
+            refill = refill || count == sharedDepthLevels;
+            std::copy(levels + index + 1, levels + count, levels + index);
+            --count;
+        } else if (present) {
+            levels[index] = PriceLevel{update.price, update.quantity, update.orderCount};
+        } else {
+            count = std::min<std::uint32_t>(count + 1, sharedDepthLevels);
+            std::copy_backward(levels + index, levels + count - 1, levels + count);
+            levels[index] = PriceLevel{update.price, update.quantity, update.orderCount};
+        }
+        return true;
+    }
+
+    void store();
+
+    std::string objectName;
+    SharedMarketDataSegment *segment = nullptr;
+    DepthSnapshot current{};
+    // Whether current holds the book's levels, publishChanges starts with a full publish otherwise
+    bool primed = false;
+    std::string openError;
+};
+
+// Maps a publisher's shared memory object read only. Reading copies a consistent snapshot out, retrying while the
+// publisher is halfway through a store, which takes as long as copying the snapshot
+class MarketDataReader {
+public:
+    explicit MarketDataReader(const std::string &name);
+    ~MarketDataReader();
+
+    MarketDataReader(const MarketDataReader &) = delete;
+    MarketDataReader &operator=(const MarketDataReader &) = delete;
+
+    bool available() const { return segment != nullptr; }
+
+    // Why the object could not be mapped, empty when it could
+    const std::string &error() const { return openError; }
+
+    // False when nothing was published yet or no consistent copy came out of maxAttempts tries, which only happens
+    // when the publisher died in the middle of a store
+    bool read(DepthSnapshot &snapshot, std::size_t maxAttempts = 1000) const;
+
+    // How old a snapshot is, measured on the same clock the publisher stamped it with
+    static std::chrono::nanoseconds age(const DepthSnapshot &snapshot);
+
+private:
+    const SharedMarketDataSegment *segment = nullptr;
+    std::string openError;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+
+// Bounded ring of trivially copyable records between one producer and one consumer thread, neither of which ever
+// waits for the other. The producer writes each record straight into its slot and publishes it with a release store
+// of the tail; the consumer reads the records where they are (peek) and hands the slots back (pop). Head and tail
+// sit on their own cache lines, and each side keeps a copy of the other's index so it only reads the shared one when
+// the ring looks full or empty
+template<typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    // Capacity is rounded up to a power of two
+    SpscRing(const std::size_t capacity, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : slots(std::bit_ceil(std::max<std::size_t>(capacity, 2)), resource), mask(slots.size() - 1) {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    std::size_t capacity() const { return slots.size(); }
+
+    // Producer side, false when the ring is full
+    bool tryPush(const T &record) {
+        const std::uint64_t position = tail.load(std::memory_order_relaxed);
+        if (position - producerHead == slots.size()) {
+            producerHead = head.load(std::memory_order_acquire);
+            if (position - producerHead == slots.size()) return false;
+        }
+        slots[position & mask] = record;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: the records published so far, up to the end of the slot array. Empty when there are none
+    std::span<const T> peek() {
+        const std::uint64_t position = head.load(std::memory_order_relaxed);
+        if (consumerTail == position) {
+            consumerTail = tail.load(std::memory_order_acquire);
+        }
+        const std::size_t first = position & mask;
+        const std::size_t count = std::min<std::uint64_t>(consumerTail - position, slots.size() - first);
+        return std::span<const T>(slots.data() + first, count);
+    }
+
+    // Consumer side, count at most what the last peek returned
+    void pop(const std::size_t count) {
+        head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+private:
+    std::pmr::vector<T> slots;
+    const std::size_t mask;
+
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    std::uint64_t consumerTail = 0;
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+    std::uint64_t producerHead = 0;
+};
+
+#endif
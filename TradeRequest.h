@@ -22,4 +22,14 @@ struct TradeRequest {
     Quantity quantity;
 };
 
+enum class EventType { Add, Cancel };
+
+// A single entry of a recorded order stream. Cancels only use order.orderId, timestamp is in nanoseconds and
+// is zero when the source has no recorded times
+struct OrderEvent {
+    EventType type;
+    std::uint64_t timestamp;
+    Order order;
+};
+
 #endif
@@ -0,0 +1,102 @@
+#ifndef VECTOR_LEVELS_H
+#define VECTOR_LEVELS_H
+#include "OrderBookConfig.h"
+#include <memory_resource>
+#include <vector>
+
+
+// Level policy (see MapLevels.h) for books of a few hundred levels. Prices sit in one contiguous vector sorted worst
+// first, so the best level is at the back: draining the touch is a pop_back and a level opening near the touch only
+// shifts the few levels after it. Queues are kept in a parallel vector in the same order.
+//
+// Lookups scan the last few prices first, since that is where the activity is, and fall back to a branchless binary
+// search over the rest
+template<typename Compare, typename Level>
+class VectorLevels {
+public:
+    VectorLevels(const OrderBookConfig &, std::pmr::memory_resource *resource) : prices(resource), queues(resource) {
+    }
+
+    void reserve(const std::size_t levels) {
+        prices.reserve(levels);
+        queues.reserve(levels);
+    }
+
+    static bool better(const Price price, const Price other) { return Compare()(price, other); }
+
+    bool empty() const { return prices.empty(); }
+
+    Price bestPrice() const { return prices.back(); }
+
+    Level &bestQueue() { return queues.back(); }
+
+    void eraseBest() {
+        prices.pop_back();
+        queues.pop_back();
+    }
+
+    Level &operator[](const Price price) {
+        const std::size_t position = lowerBound(price);
+        if (position < prices.size() && prices[position] == price) {
+            return queues[position];
+        }
+        prices.insert(prices.begin() + static_cast<std::ptrdiff_t>(position), price);
+        return *queues.emplace(queues.begin() + static_cast<std::ptrdiff_t>(position));
+    }
+
+    Level *find(const Price price) {
+        const std::size_t position = lowerBound(price);
+        return position < prices.size() && prices[position] == price ? &queues[position] : nullptr;
+    }
+
+    const Level *find(const Price price) const {
+        const std::size_t position = lowerBound(price);
+        return position < prices.size() && prices[position] == price ? &queues[position] : nullptr;
+    }
+
+    void erase(const Price price) {
+        const auto position = static_cast<std::ptrdiff_t>(lowerBound(price));
+        prices.erase(prices.begin() + position);
+        queues.erase(queues.begin() + position);
+    }
+
+    template<typename Visit>
+    void forEachLevel(Visit &&visit) const {
+        for (std::size_t i = prices.size(); i-- > 0;) {
+            if (!visit(prices[i], queues[i])) return;
+        }
+    }
+
+private:
+    // Levels checked from the back before searching the rest of the vector
+    static constexpr std::size_t nearLevels = 8;
+
+    // Index of the first price not worse than price, i.e. where price is or would be inserted
+    std::size_t lowerBound(const Price price) const {
+        std::size_t end = prices.size();
+        const std::size_t nearEnd = end > nearLevels ? end - nearLevels : 0;
+        while (end > nearEnd && !better(price, prices[end - 1])) {
+            --end;
+        }
+        if (end > nearEnd || end == 0 || better(price, prices[end - 1])) {
+            return end;
+        }
+
+        // prices[end - 1] is not worse than price either, search the ones before it. The step compiles to a
+        // conditional move
+        const Price *base = prices.data();
+        std::size_t length = end - 1;
+        if (length == 0) return 0;
+        while (length > 1) {
+            const std::size_t half = length / 2;
+            base = better(price, base[half - 1]) ? base + half : base;
+            length -= half;
+        }
+        return static_cast<std::size_t>(base - prices.data()) + better(price, *base);
+    }
+
+    std::pmr::vector<Price> prices;
+    std::pmr::vector<Level> queues;
+};
+
+#endif
@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include "AllocationCounter.h"
+#include "Conformance.h"
+#include "OrderBook.h"
+#include "PerfCounters.h"
+#include "functions.h"
+
+
+// Microbenchmarks for the individual OrderBook operations. Every case runs against a book prefilled with `depth`
+// levels per side and `orders per level` resting orders on each level, and times single operations. Whatever an
+// operation changes is put back untimed before the next iteration so every sample sees the same book.
+// Results are printed as JSON so they can be stored and compared between releases. With --perf every timed
+// operation is also wrapped in a group of hardware counters and the per operation averages are reported. With
+// --check-allocations the book is built with a capacity reservation and any allocation inside a timed operation
+// after warm-up fails the run. With --events the recorded stream is replayed instead, once per memory resource
+// the book can run on. --huge-pages runs every case a second time on a book backed by huge pages, --lazy-cancels
+// every case and stream on a book that cancels lazily (see OrderBookConfig::lazyCancels), --depth-index every case on
+// a book with a depth index wide enough for the whole side (see OrderBookConfig::depthIndexTicks), --queue-positions
+// every case on a book that tracks queue positions (see OrderBookConfig::trackQueuePositions).
+// Everything runs once per backend (level and queue policy combination, see forEachOrderBookBackend), --backends
+// narrows that down. --verify checks that all backends behave identically instead of timing anything.
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr Price midPrice = 100000;
+    constexpr Quantity orderQuantity = 100;
+    constexpr std::size_t depthQueryLevels = 10;
+
+    struct Options {
+        std::vector<std::size_t> depths{10, 100, 1000};
+        std::vector<std::size_t> ordersPerLevel{1, 10};
+        std::vector<std::size_t> sweepLevels{1, 5};
+        std::size_t iterations = 20000;
+        std::size_t warmup = 1000;
+        std::string outputPath;
+        std::string eventsPath;
+        // Empty means every backend
+        std::vector<std::string> backends;
+        bool perf = false;
+        bool verify = false;
+        bool checkAllocations = false;
+        bool hugePages = false;
+        bool lazyCancels = false;
+        bool depthIndex = false;
+        bool queuePositions = false;
+    };
+
+    struct CaseParameters {
+        std::size_t depth;
+        std::size_t ordersPerLevel;
+        std::size_t sweepLevels;
+        // Free form name of the configuration under test, e.g. the memory resource
+        const char *variant = "";
+        bool hugePages = false;
+        const char *backend = "";
+        bool lazyCancels = false;
+        bool depthIndex = false;
+        bool queuePositions = false;
+    };
+
+    struct Result {
+        std::string name;
+        CaseParameters parameters;
+        std::size_t iterations;
+        double mean;
+        double min;
+        double p50;
+        double p90;
+        double p99;
+        PerfCounts perf;
+        std::uint64_t allocations;
+    };
+
+    // The book under test plus the ids and references resting on each bid level, front of the queue first
+    template<typename Book>
+    struct Fixture {
+        Book book;
+        std::vector<std::deque<OrderId> > bidQueues;
+        std::vector<std::deque<OrderRef> > bidRefs;
+        std::vector<TradeRequest> trades;
+        OrderId nextOrderId = 1;
+
+        explicit Fixture(const CaseParameters &parameters)
+            : book(capacity(parameters)), bidQueues(parameters.depth), bidRefs(parameters.depth) {
+            trades.reserve(book.getConfig().maxFillsPerCall);
+            for (std::size_t level = 0; level < parameters.depth; ++level) {
+                for (std::size_t i = 0; i < parameters.ordersPerLevel; ++i) {
+                    bidQueues[level].push_back(nextOrderId);
+                    bidRefs[level].push_back(add(nextOrderId++, bidPrice(level), Side::Buy));
+                    add(nextOrderId++, askPrice(level), Side::Sell);
+                }
+            }
+        }
+
+        // Everything the cases can reach: both sides fully populated, one extra order and sweeps of the whole side
+        static OrderBookConfig capacity(const CaseParameters &parameters) {
+            const std::size_t orders = parameters.depth * parameters.ordersPerLevel;
+            OrderBookConfig config{2 * orders + 1, parameters.depth + 1, orders};
+            config.hugePages = parameters.hugePages;
+            if (parameters.lazyCancels) {
+                // Dead orders hold on to their slot until the book compacts, see OrderBookConfig::lazyCancels
+                config.maxOrders *= 2;
+                config.lazyCancels = true;
+            }
+            if (parameters.depthIndex) {
+                // The best level sits a quarter into the window, this leaves room for the rest of the side behind it
+                config.depthIndexTicks = 2 * parameters.depth + 64;
+            }
+            config.trackQueuePositions = parameters.queuePositions;
+            return config;
+        }
+
+        static Price bidPrice(const std::size_t level) { return midPrice - 1 - level; }
+        static Price askPrice(const std::size_t level) { return midPrice + 1 + level; }
+
+        OrderRef add(const OrderId orderId, const Price price, const Side side, const Quantity quantity = orderQuantity) {
+            Order order{orderId, quantity, price, side};
+            trades.clear();
+            return book.addOrder(order, trades);
+        }
+    };
+
+    std::vector<std::string> parseNames(const std::string &argument) {
+        std::vector<std::string> names;
+        std::size_t start = 0;
+        while (start <= argument.size()) {
+            const std::size_t comma = std::min(argument.find(',', start), argument.size());
+            names.push_back(argument.substr(start, comma - start));
+            start = comma + 1;
+        }
+        return names;
+    }
+
+    std::vector<std::size_t> parseList(const std::string &argument) {
+        std::vector<std::size_t> values;
+        for (const std::string &name: parseNames(argument)) {
+            values.push_back(std::stoul(name));
+        }
+        return values;
+    }
+
+    bool parseOptions(const int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument = argv[i];
+            if (argument == "--perf") {
+                options.perf = true;
+                continue;
+            }
+            if (argument == "--huge-pages") {
+                options.hugePages = true;
+                continue;
+            }
+            if (argument == "--lazy-cancels") {
+                options.lazyCancels = true;
+                continue;
+            }
+            if (argument == "--depth-index") {
+                options.depthIndex = true;
+                continue;
+            }
+            if (argument == "--queue-positions") {
+                options.queuePositions = true;
+                continue;
+            }
+            if (argument == "--verify") {
+                options.verify = true;
+                continue;
+            }
+            if (argument == "--check-allocations") {
+                options.checkAllocations = true;
+                continue;
+            }
+            if (i + 1 >= argc) return false;
+            if (argument == "--depths") {
+                options.depths = parseList(argv[++i]);
+            } else if (argument == "--orders-per-level") {
+                options.ordersPerLevel = parseList(argv[++i]);
+            } else if (argument == "--sweep-levels") {
+                options.sweepLevels = parseList(argv[++i]);
+            } else if (argument == "--iterations") {
+                options.iterations = std::stoul(argv[++i]);
+            } else if (argument == "--backends") {
+                options.backends = parseNames(argv[++i]);
+            } else if (argument == "--events") {
+                options.eventsPath = argv[++i];
+            } else if (argument == "--output") {
+                options.outputPath = argv[++i];
+            } else {
+                return false;
+            }
+        }
+        return options.iterations > 0;
+    }
+
+    // Cost of the two clock reads around every sample, subtracted from the measurements
+    double clockOverhead() {
+        std::vector<double> samples(10000);
+        for (auto &sample: samples) {
+            const Clock::time_point before = Clock::now();
+            const Clock::time_point after = Clock::now();
+            sample = std::chrono::duration<double, std::nano>(after - before).count();
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    struct Harness {
+        const Options &options;
+        double clockOverhead;
+        // Only set in --perf mode when the counters could be opened
+        PerfCounterGroup *counters;
+        // Counts of an empty operation, i.e. what enabling and disabling the group costs by itself
+        PerfCounts counterOverhead;
+        std::vector<Result> results;
+
+        // Times operation(i) for every iteration, restore(i) runs untimed afterwards to undo its effect on the book
+        template<typename Operation, typename Restore>
+        void measure(const std::string &name, const CaseParameters &parameters, Operation &&operation,
+                     Restore &&restore) {
+            measure(name, parameters, options.warmup, options.iterations, operation, restore);
+        }
+
+        template<typename Operation, typename Restore>
+        void measure(const std::string &name, const CaseParameters &parameters, const std::size_t warmup,
+                     const std::size_t iterations, Operation &&operation, Restore &&restore) {
+            std::vector<double> samples;
+            samples.reserve(iterations);
+            PerfCounts perf;
+            for (bool &valid: perf.valid) valid = true;
+            std::uint64_t allocations = 0;
+
+            for (std::size_t i = 0; i < warmup + iterations; ++i) {
+                if (counters != nullptr) counters->start();
+                const std::uint64_t allocationsBefore = allocationCount();
+                const Clock::time_point before = Clock::now();
+                operation(i);
+                const Clock::time_point after = Clock::now();
+                if (counters != nullptr) counters->stop();
+                if (i >= warmup) {
+                    allocations += allocationCount() - allocationsBefore;
+                    samples.push_back(std::max(0.0, std::chrono::duration<double, std::nano>(after - before).count()
+                                                    - clockOverhead));
+                    if (counters != nullptr) perf += counters->read();
+                }
+                restore(i);
+            }
+
+            double total = 0;
+            for (const double sample: samples) total += sample;
+            std::sort(samples.begin(), samples.end());
+            const auto at = [&samples](const double fraction) {
+                return samples[static_cast<std::size_t>(fraction * static_cast<double>(samples.size() - 1))];
+            };
+
+            results.push_back(Result{
+                name, parameters, samples.size(), total / static_cast<double>(samples.size()), samples.front(),
+                at(0.5), at(0.9), at(0.99), perf, allocations
+            });
+        }
+
+        // Per operation average of a counter after removing the cost of the measurement itself
+        double perOperation(const Result &result, const std::size_t event) const {
+            const double value = static_cast<double>(result.perf.values[event]) / static_cast<double>(result.iterations);
+            return std::max(0.0, value - static_cast<double>(counterOverhead.values[event]));
+        }
+    };
+
+    PerfCounts measureCounterOverhead(PerfCounterGroup &counters) {
+        constexpr std::uint64_t samples = 10000;
+        PerfCounts total;
+        for (bool &valid: total.valid) valid = true;
+        for (std::uint64_t i = 0; i < samples; ++i) {
+            counters.start();
+            counters.stop();
+            total += counters.read();
+        }
+        for (auto &value: total.values) value /= samples;
+        return total;
+    }
+
+    template<typename Book>
+    void runCases(const CaseParameters &parameters, Harness &harness) {
+        const Options &options = harness.options;
+        const std::size_t depth = parameters.depth;
+        const std::size_t ordersPerLevel = parameters.ordersPerLevel;
+
+        // A new order joining the back of an existing level
+        {
+            Fixture<Book> fixture(parameters);
+            harness.measure("passive_add", parameters, [&](const std::size_t i) {
+                fixture.add(fixture.nextOrderId, Fixture<Book>::bidPrice(i % depth), Side::Buy);
+            }, [&](std::size_t) {
+                fixture.book.removeOrder(fixture.nextOrderId++);
+            });
+        }
+
+        // A sell order that fills every order on the best sweepLevels bid levels
+        for (const std::size_t levels: options.sweepLevels) {
+            if (levels == 0 || levels > depth) continue;
+            Fixture<Book> fixture(parameters);
+            const auto quantity = static_cast<Quantity>(levels * ordersPerLevel * orderQuantity);
+            CaseParameters sweepParameters = parameters;
+            sweepParameters.sweepLevels = levels;
+            harness.measure("aggressive_add", sweepParameters, [&](std::size_t) {
+                fixture.add(fixture.nextOrderId, Fixture<Book>::bidPrice(levels - 1), Side::Sell, quantity);
+            }, [&](std::size_t) {
+                ++fixture.nextOrderId;
+                for (std::size_t level = 0; level < levels; ++level) {
+                    for (const OrderId orderId: fixture.bidQueues[level]) {
+                        fixture.add(orderId, Fixture<Book>::bidPrice(level), Side::Buy);
+                    }
+                }
+            });
+
+            // The same sell only simulated, which leaves the book as it is
+            std::vector<TradeRequest> fills(levels * ordersPerLevel);
+            std::uint64_t sink = 0;
+            harness.measure("simulate_order", sweepParameters, [&](std::size_t) {
+                const Order order{fixture.nextOrderId, quantity, Fixture<Book>::bidPrice(levels - 1), Side::Sell};
+                sink += fixture.book.simulateOrder(order, fills.data(), fills.size()).fillCount;
+            }, [](std::size_t) {
+            });
+            if (sink == 0) std::cerr << "Simulated order did not fill" << std::endl;
+        }
+
+        // A bid inside the spread opening a new best level, cancelled again so the level goes away
+        {
+            Fixture<Book> fixture(parameters);
+            harness.measure("new_best_level", parameters, [&](std::size_t) {
+                fixture.add(fixture.nextOrderId, Fixture<Book>::bidPrice(0) + 1, Side::Buy);
+            }, [&](std::size_t) {
+                fixture.book.removeOrder(fixture.nextOrderId++);
+            });
+        }
+
+        // Cancelling the order at the front of a queue, it rejoins at the back afterwards
+        {
+            Fixture<Book> fixture(parameters);
+            harness.measure("cancel_top", parameters, [&](const std::size_t i) {
+                fixture.book.removeOrder(fixture.bidQueues[i % depth].front());
+            }, [&](const std::size_t i) {
+                auto &queue = fixture.bidQueues[i % depth];
+                fixture.add(queue.front(), Fixture<Book>::bidPrice(i % depth), Side::Buy);
+                queue.push_back(queue.front());
+                queue.pop_front();
+            });
+        }
+
+        // Cancelling the order in the middle of a queue, only meaningful with at least three orders per level
+        if (ordersPerLevel >= 3) {
+            Fixture<Book> fixture(parameters);
+            harness.measure("cancel_middle", parameters, [&](const std::size_t i) {
+                const auto &queue = fixture.bidQueues[i % depth];
+                fixture.book.removeOrder(queue[queue.size() / 2]);
+            }, [&](const std::size_t i) {
+                auto &queue = fixture.bidQueues[i % depth];
+                const auto middle = queue.begin() + static_cast<std::ptrdiff_t>(queue.size() / 2);
+                const OrderId orderId = *middle;
+                fixture.add(orderId, Fixture<Book>::bidPrice(i % depth), Side::Buy);
+                queue.erase(middle);
+                queue.push_back(orderId);
+            });
+        }
+
+        // Cancelling an order anywhere in the book, touching memory all over it like cancels in a deep book do
+        {
+            Fixture<Book> fixture(parameters);
+            std::uint64_t state = 1;
+            std::size_t level = 0;
+            std::size_t position = 0;
+            harness.measure("cancel_random", parameters, [&](std::size_t) {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                level = (state >> 33) % depth;
+                position = (state >> 13) % ordersPerLevel;
+                fixture.book.removeOrder(fixture.bidQueues[level][position]);
+            }, [&](std::size_t) {
+                auto &queue = fixture.bidQueues[level];
+                const auto it = queue.begin() + static_cast<std::ptrdiff_t>(position);
+                const OrderId orderId = *it;
+                fixture.add(orderId, Fixture<Book>::bidPrice(level), Side::Buy);
+                queue.erase(it);
+                queue.push_back(orderId);
+            });
+        }
+
+        // Same cancels through the reference addOrder returned, which skips the id lookup
+        {
+            Fixture<Book> fixture(parameters);
+            CaseParameters refParameters = parameters;
+            refParameters.variant = "ref";
+            std::uint64_t state = 1;
+            std::size_t level = 0;
+            std::size_t position = 0;
+            harness.measure("cancel_random", refParameters, [&](std::size_t) {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                level = (state >> 33) % depth;
+                position = (state >> 13) % ordersPerLevel;
+                fixture.book.removeOrder(fixture.bidRefs[level][position]);
+            }, [&](std::size_t) {
+                auto &queue = fixture.bidRefs[level];
+                const auto it = queue.begin() + static_cast<std::ptrdiff_t>(position);
+                queue.erase(it);
+                queue.push_back(fixture.add(fixture.nextOrderId++, Fixture<Book>::bidPrice(level), Side::Buy));
+            });
+        }
+
+        // Aggregated quantity and order count of the best levels
+        {
+            Fixture<Book> fixture(parameters);
+            PriceLevel levels[depthQueryLevels];
+            std::uint64_t sink = 0;
+            harness.measure("depth_query", parameters, [&](std::size_t) {
+                const std::size_t count = fixture.book.getDepth(Side::Buy, levels, depthQueryLevels);
+                sink += levels[count - 1].quantity;
+            }, [](std::size_t) {
+            });
+            if (sink == 0) std::cerr << "Depth query returned an empty book" << std::endl;
+        }
+
+        // Quantity resting down to the worst bid, and the price a sell of half the side would have to go to
+        {
+            Fixture<Book> fixture(parameters);
+            const Price worstBid = Fixture<Book>::bidPrice(depth - 1);
+            const std::uint64_t halfSide = depth * ordersPerLevel * orderQuantity / 2;
+            std::uint64_t sink = 0;
+            harness.measure("cumulative_quantity", parameters, [&](std::size_t) {
+                sink += fixture.book.getCumulativeQuantity(Side::Buy, worstBid);
+            }, [](std::size_t) {
+            });
+            harness.measure("fill_price", parameters, [&](std::size_t) {
+                Price price = 0;
+                fixture.book.getFillPrice(Side::Buy, halfSide, price);
+                sink += price;
+            }, [](std::size_t) {
+            });
+            if (sink == 0) std::cerr << "Cumulative depth query returned an empty book" << std::endl;
+        }
+
+        // Quantity ahead of the order at the back of a level, by reference
+        {
+            Fixture<Book> fixture(parameters);
+            std::uint64_t sink = 0;
+            harness.measure("quantity_ahead", parameters, [&](const std::size_t i) {
+                std::uint64_t quantity = 0;
+                fixture.book.getQuantityAhead(fixture.bidRefs[i % depth].back(), quantity);
+                sink += quantity;
+            }, [](std::size_t) {
+            });
+            if (ordersPerLevel > 1 && sink == 0) std::cerr << "Queue position query found nothing ahead" << std::endl;
+        }
+    }
+
+    // Replays a whole event stream, each event is one sample
+    template<typename Book>
+    void runStream(const std::vector<OrderEvent> &events, const char *backend, Harness &harness) {
+        for (const char *variant: {"node_pool", "new_delete", "unsynchronized_pool", "monotonic", "lazy_cancels"}) {
+            const std::string name = variant;
+            if (name == "lazy_cancels" && !harness.options.lazyCancels) continue;
+            std::unique_ptr<std::pmr::memory_resource> ownedResource;
+            OrderBookConfig config;
+            if (name == "lazy_cancels") {
+                config.lazyCancels = true;
+            } else if (name == "new_delete") {
+                config.memoryResource = std::pmr::new_delete_resource();
+            } else if (name == "unsynchronized_pool") {
+                ownedResource = std::make_unique<std::pmr::unsynchronized_pool_resource>();
+                config.memoryResource = ownedResource.get();
+            } else if (name == "monotonic") {
+                ownedResource = std::make_unique<std::pmr::monotonic_buffer_resource>();
+                config.memoryResource = ownedResource.get();
+            }
+
+            Book book(config);
+            TradeBuffer trades = book.makeTradeBuffer();
+            const CaseParameters parameters{0, 0, 0, variant, false, backend};
+            harness.measure("replay", parameters, 0, events.size(), [&](const std::size_t i) {
+                const OrderEvent &event = events[i];
+                if (event.type == EventType::Add) {
+                    Order order = event.order;
+                    trades.clear();
+                    book.addOrder(order, trades);
+                } else {
+                    book.removeOrder(event.order.orderId);
+                }
+            }, [](std::size_t) {
+            });
+        }
+    }
+
+    void writeJson(std::FILE *out, const Harness &harness, const PerfCounterGroup *counters) {
+        std::fprintf(out, "{\n  \"benchmark\": \"OrderBook\",\n  \"unit\": \"ns\",\n");
+        std::fprintf(out, "  \"clock_overhead\": %.1f,\n", harness.clockOverhead);
+        if (counters != nullptr) {
+            std::fprintf(out, "  \"perf_available\": %s,\n", counters->available() ? "true" : "false");
+            if (!counters->available()) std::fprintf(out, "  \"perf_error\": \"%s\",\n", counters->error().c_str());
+        }
+        if (harness.options.hugePages) {
+            OrderBookConfig config;
+            config.hugePages = true;
+            config.maxOrders = 1;
+            std::fprintf(out, "  \"huge_page_mode\": \"%s\",\n", hugePageModeName(OrderBook(config).getHugePageMode()));
+        }
+        std::fprintf(out, "  \"results\": [\n");
+
+        const std::vector<Result> &results = harness.results;
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const Result &result = results[i];
+            std::fprintf(out, "    {\"name\": \"%s\", \"backend\": \"%s\", \"depth\": %zu, \"orders_per_level\": %zu, "
+                         "\"sweep_levels\": %zu, \"iterations\": %zu, \"mean\": %.1f, \"min\": %.1f, "
+                         "\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f",
+                         result.name.c_str(), result.parameters.backend, result.parameters.depth, result.parameters.ordersPerLevel,
+                         result.parameters.sweepLevels, result.iterations, result.mean, result.min, result.p50,
+                         result.p90, result.p99);
+            if (*result.parameters.variant != '\0') {
+                std::fprintf(out, ", \"variant\": \"%s\"", result.parameters.variant);
+            }
+            if (harness.options.checkAllocations) {
+                std::fprintf(out, ", \"allocations\": %llu", static_cast<unsigned long long>(result.allocations));
+            }
+            if (harness.counters != nullptr) {
+                std::fprintf(out, ", \"perf\": {");
+                for (std::size_t event = 0; event < perfEventCount; ++event) {
+                    std::fprintf(out, "%s\"%s\": ", event == 0 ? "" : ", ", perfEventName(static_cast<PerfEvent>(event)));
+                    if (result.perf.valid[event] && harness.counterOverhead.valid[event]) {
+                        std::fprintf(out, "%.2f", harness.perOperation(result, event));
+                    } else {
+                        std::fprintf(out, "null");
+                    }
+                }
+                std::fprintf(out, "}");
+            }
+            std::fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: OrderBookBench [--depths 10,100] [--orders-per-level 1,10] [--sweep-levels 1,5] "
+                "[--iterations N] [--perf] [--check-allocations] [--huge-pages] [--lazy-cancels] [--depth-index] "
+                "[--queue-positions] [--events stream-file] [--backends ladder_linked,map_list] [--output file.json] "
+                "| OrderBookBench --verify" << std::endl;
+        return 1;
+    }
+
+    if (options.verify) {
+        return verifyOrderBookBackends(std::cerr) ? 0 : 1;
+    }
+
+    std::unique_ptr<PerfCounterGroup> counters;
+    if (options.perf) {
+        counters = std::make_unique<PerfCounterGroup>();
+        if (!counters->available()) {
+            std::cerr << "Hardware counters unavailable, reporting wall time only: " << counters->error() << std::endl;
+        }
+    }
+
+    Harness harness{options, clockOverhead(), nullptr, PerfCounts(), {}};
+    if (counters != nullptr && counters->available()) {
+        harness.counters = counters.get();
+        harness.counterOverhead = measureCounterOverhead(*counters);
+    }
+
+    const std::vector<OrderEvent> events = options.eventsPath.empty()
+                                               ? std::vector<OrderEvent>()
+                                               : loadEvents(options.eventsPath);
+    forEachOrderBookBackend([&]<typename Book>(const char *backend) {
+        if (!options.backends.empty() &&
+            std::find(options.backends.begin(), options.backends.end(), backend) == options.backends.end()) {
+            return;
+        }
+        if (!options.eventsPath.empty()) {
+            runStream<Book>(events, backend, harness);
+            return;
+        }
+        for (const std::size_t depth: options.depths) {
+            for (const std::size_t ordersPerLevel: options.ordersPerLevel) {
+                if (depth == 0 || ordersPerLevel == 0) continue;
+                runCases<Book>(CaseParameters{depth, ordersPerLevel, 0, "", false, backend}, harness);
+                if (options.hugePages) {
+                    runCases<Book>(CaseParameters{depth, ordersPerLevel, 0, "huge_pages", true, backend}, harness);
+                }
+                if (options.lazyCancels) {
+                    runCases<Book>(CaseParameters{depth, ordersPerLevel, 0, "lazy_cancels", false, backend, true},
+                                   harness);
+                }
+                if (options.depthIndex) {
+                    runCases<Book>(CaseParameters{depth, ordersPerLevel, 0, "depth_index", false, backend, false, true},
+                                   harness);
+                }
+                if (options.queuePositions) {
+                    runCases<Book>(CaseParameters{
+                                       depth, ordersPerLevel, 0, "queue_positions", false, backend, false, false, true
+                                   }, harness);
+                }
+            }
+        }
+    });
+
+    std::FILE *out = options.outputPath.empty() ? stdout : std::fopen(options.outputPath.c_str(), "w");
+    if (out == nullptr) {
+        std::cerr << "Cannot open " << options.outputPath << std::endl;
+        return 1;
+    }
+    writeJson(out, harness, counters.get());
+    if (out != stdout) std::fclose(out);
+
+    if (options.checkAllocations) {
+        bool allocated = false;
+        for (const Result &result: harness.results) {
+            if (result.allocations == 0) continue;
+            std::cerr << result.name << " on " << result.parameters.backend << " (depth " << result.parameters.depth << ", orders per level "
+                    << result.parameters.ordersPerLevel << ") allocated " << result.allocations
+                    << " times after warm-up" << std::endl;
+            allocated = true;
+        }
+        if (allocated) return 1;
+    }
+
+    return 0;
+}
@@ -1,34 +1,193 @@
 #include "functions.h"
 
+#include <array>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
 
+namespace {
+    template<typename T>
+    bool parseInteger(const std::string_view token, T &value) {
+        const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+        return error == std::errc() && end == token.data() + token.size();
+    }
+}
+
 std::vector<Order> getOrders(std::ifstream &inFile) {
+    std::vector<Order> orders;
+
+    for (const auto &event: getEvents(inFile)) {
+        if (event.type == EventType::Add) {
+            orders.push_back(event.order);
+        }
+    }
+
+    return orders;
+}
+
+std::vector<OrderEvent> getEvents(std::ifstream &inFile) {
     if (!inFile.is_open()) {
         throw std::domain_error("Cannot parse data");
     }
     std::string line;
-    std::vector<Order> orders;
+    std::vector<OrderEvent> events;
 
-    // We receive data in format: orderId,quantity,price,side (e.g., 1,100,10.5,Buy)
     while (std::getline(inFile, line)) {
-        std::vector<std::string> tokens = parseTokens(line, ',');
-        if (tokens.size() != 4) {
+        OrderEvent event{};
+        if (!parseEvent(line, event)) {
             std::cerr << "Skipping invalid line: " << line << std::endl;
             continue;
         }
-        orders.emplace_back(Order{
-                std::stoll(tokens[0]),
-                static_cast<Quantity>(stoul(tokens[1])),
-                static_cast<Price>(std::stod(tokens[2]) * 100), // Convert to integer representation for full accuracy
-                tokens[3] == "Buy" ? Side::Buy : Side::Sell,
-            }
-        );
+        events.push_back(event);
     }
 
-    return orders;
+    return events;
+}
+
+// We receive data in format: orderId,quantity,price,side[,timestamp] (e.g., 1,100,10.5,Buy)
+// Side is one of Buy, Sell or Cancel, for cancels only the orderId is used. The optional timestamp is in nanoseconds
+bool parseEvent(std::string_view line, OrderEvent &event) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+    std::array<std::string_view, 5> tokens;
+    std::size_t tokenCount = 0;
+    while (tokenCount < tokens.size()) {
+        const std::size_t comma = line.find(',');
+        tokens[tokenCount++] = line.substr(0, comma);
+        if (comma == std::string_view::npos) break;
+        line.remove_prefix(comma + 1);
+        if (tokenCount == tokens.size()) return false;
+    }
+    if (tokenCount < 4) return false;
+
+    event.timestamp = 0;
+    if (tokenCount == 5 && !parseInteger(tokens[4], event.timestamp)) return false;
+    if (!parseInteger(tokens[0], event.order.orderId)) return false;
+
+    if (tokens[3] == "Cancel") {
+        event.type = EventType::Cancel;
+        event.order.quantity = 0;
+        event.order.price = 0;
+        event.order.side = Side::Buy;
+        return true;
+    }
+
+    if (tokens[3] == "Buy") {
+        event.order.side = Side::Buy;
+    } else if (tokens[3] == "Sell") {
+        event.order.side = Side::Sell;
+    } else {
+        return false;
+    }
+    event.type = EventType::Add;
+
+    return parseInteger(tokens[1], event.order.quantity) && parsePrice(tokens[2], event.order.price);
+}
+
+// Inverse of parseEvent, writes a line including the trailing newline and returns its length
+std::size_t formatEvent(const OrderEvent &event, char *buffer) {
+    char *const end = buffer + maxFormattedEventLength;
+    char *out = std::to_chars(buffer, end, event.order.orderId).ptr;
+
+    if (event.type == EventType::Cancel) {
+        std::memcpy(out, ",0,0,Cancel,", 12);
+        out += 12;
+    } else {
+        *out++ = ',';
+        out = std::to_chars(out, end, event.order.quantity).ptr;
+        *out++ = ',';
+        out = std::to_chars(out, end, event.order.price / 100).ptr;
+        const auto cents = static_cast<char>(event.order.price % 100);
+        *out++ = '.';
+        *out++ = static_cast<char>('0' + cents / 10);
+        *out++ = static_cast<char>('0' + cents % 10);
+        if (event.order.side == Side::Buy) {
+            std::memcpy(out, ",Buy,", 5);
+            out += 5;
+        } else {
+            std::memcpy(out, ",Sell,", 6);
+            out += 6;
+        }
+    }
+
+    out = std::to_chars(out, end, event.timestamp).ptr;
+    *out++ = '\n';
+    return static_cast<std::size_t>(out - buffer);
+}
+
+std::vector<OrderEvent> getBinaryEvents(std::ifstream &inFile) {
+    if (!inFile.is_open()) {
+        throw std::domain_error("Cannot parse data");
+    }
+    char magic[sizeof(binaryEventMagic)];
+    if (!inFile.read(magic, sizeof(magic)) || std::memcmp(magic, binaryEventMagic, sizeof(magic)) != 0) {
+        throw std::domain_error("Not a binary event file");
+    }
+
+    std::vector<OrderEvent> events;
+    std::vector<BinaryEvent> records(1 << 16);
+    while (inFile) {
+        inFile.read(reinterpret_cast<char *>(records.data()),
+                    static_cast<std::streamsize>(records.size() * sizeof(BinaryEvent)));
+        const auto count = static_cast<std::size_t>(inFile.gcount()) / sizeof(BinaryEvent);
+        for (std::size_t i = 0; i < count; ++i) events.push_back(fromBinaryEvent(records[i]));
+    }
+
+    return events;
+}
+
+// Reads either format, binary files are recognised by their magic
+std::vector<OrderEvent> loadEvents(const std::string &path) {
+    std::ifstream inFile(path, std::ios::binary);
+    char magic[sizeof(binaryEventMagic)] = {};
+    inFile.read(magic, sizeof(magic));
+    const bool binary = inFile.gcount() == sizeof(magic) &&
+                        std::memcmp(magic, binaryEventMagic, sizeof(magic)) == 0;
+    inFile.clear();
+    inFile.seekg(0);
+
+    return binary ? getBinaryEvents(inFile) : getEvents(inFile);
+}
+
+BinaryEvent toBinaryEvent(const OrderEvent &event) {
+    return BinaryEvent{
+        event.order.orderId,
+        event.order.price,
+        event.timestamp,
+        event.order.quantity,
+        static_cast<std::uint8_t>(event.type),
+        static_cast<std::uint8_t>(event.order.side),
+        {}
+    };
+}
+
+OrderEvent fromBinaryEvent(const BinaryEvent &record) {
+    return OrderEvent{
+        static_cast<EventType>(record.type),
+        record.timestamp,
+        Order{record.orderId, record.quantity, record.price, static_cast<Side>(record.side)}
+    };
+}
+
+// Converts a decimal price with at most two decimal places into its integer representation in cents. Parsing the
+// digits directly avoids the rounding errors of going through a double (e.g., 101.30 * 100 = 10129.999...)
+bool parsePrice(const std::string_view token, Price &price) {
+    const std::size_t dot = token.find('.');
+    Price units = 0;
+    if (!parseInteger(token.substr(0, dot), units)) return false;
+
+    Price cents = 0;
+    if (dot != std::string_view::npos) {
+        const std::string_view fraction = token.substr(dot + 1);
+        if (fraction.empty() || fraction.size() > 2 || !parseInteger(fraction, cents)) return false;
+        if (fraction.size() == 1) cents *= 10;
+    }
+
+    price = units * 100 + cents;
+    return true;
 }
 
 // Utility function to split a string by a given delimiter
@@ -1,11 +1,48 @@
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
+#include <fstream>
+#include <string>
+#include <string_view>
 #include <vector>
 #include "TradeRequest.h"
 
+// Binary event files start with this magic, followed by one fixed size record per event in native (little-endian)
+// byte order. They are several times faster to load than the CSV form
+constexpr char binaryEventMagic[8] = {'O', 'B', 'E', 'V', 'E', 'N', 'T', '1'};
+
+struct BinaryEvent {
+    std::int64_t orderId;
+    std::uint64_t price;
+    std::uint64_t timestamp;
+    std::uint32_t quantity;
+    std::uint8_t type;
+    std::uint8_t side;
+    std::uint8_t padding[2];
+};
+
+static_assert(sizeof(BinaryEvent) == 32);
+
+// Upper bound of the characters formatEvent writes
+constexpr std::size_t maxFormattedEventLength = 96;
 
 std::vector<Order> getOrders(std::ifstream &inFile);
 
+std::vector<OrderEvent> getEvents(std::ifstream &inFile);
+
+bool parseEvent(std::string_view line, OrderEvent &event);
+
+std::size_t formatEvent(const OrderEvent &event, char *buffer);
+
+std::vector<OrderEvent> getBinaryEvents(std::ifstream &inFile);
+
+std::vector<OrderEvent> loadEvents(const std::string &path);
+
+BinaryEvent toBinaryEvent(const OrderEvent &event);
+
+OrderEvent fromBinaryEvent(const BinaryEvent &record);
+
+bool parsePrice(std::string_view token, Price &price);
+
 float formatPrice(Price price);
 
 std::vector<std::string> parseTokens(const std::string &line, char delimiter);
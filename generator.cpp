@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "OrderBook.h"
+#include "TradeRequest.h"
+#include "functions.h"
+
+
+// Generates synthetic order streams for load testing. Arrivals are Poisson, passive prices cluster near the touch
+// with a geometric distance, every resting order is equally likely to be cancelled next and occasional bursts of
+// aggressive orders sweep several levels and move the price. The stream is matched in a book as it is generated, so
+// cancels only go to orders that still rest. The output only depends on the options and the seed.
+namespace {
+    struct Options {
+        std::string outputPath;
+        bool binary = false;
+        std::uint64_t events = 1000000;
+        std::uint64_t seed = 1;
+        double rate = 100000;            // Mean events per second
+        // Resting orders the cancels hold the book at. Each resting order is cancelled at the same rate per event,
+        // chosen so that cancels balance the adds once this many rest, i.e. with n resting orders an event is a
+        // cancel with probability n / (n + restingOrders). Fills keep the book somewhat below it, and nearly every
+        // order that does not trade ends up cancelled
+        double restingOrders = 1000;
+        double aggressiveRatio = 0.05;   // Share of adds that cross the spread
+        double touchOffset = 2;          // Mean distance of passive orders from the touch in ticks
+        double sweepProbability = 0.001; // Chance per event that a burst of sweeps starts
+        double sweepLevels = 5;          // Mean levels crossed by each order of a burst
+        double burstLength = 4;          // Mean number of orders in a burst
+        Price midPrice = 10000;
+        double meanLots = 3;             // Mean order size in lots of 100
+    };
+
+    // xoshiro256** seeded through splitmix64. The standard distributions are not specified bit for bit, so all
+    // sampling is done by hand. Exponential and geometric draws still go through std::log1p, which libms are free to
+    // round differently in the last bit, so streams are only identical between builds on the same C library
+    class Random {
+    public:
+        explicit Random(std::uint64_t seed) {
+            for (auto &word: state) {
+                seed += 0x9e3779b97f4a7c15ull;
+                std::uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        std::uint64_t next() {
+            const std::uint64_t result = rotl(state[1] * 5, 7) * 9;
+            const std::uint64_t t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = rotl(state[3], 45);
+            return result;
+        }
+
+        // Uniform in [0, 1)
+        double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+        bool chance(const double probability) { return uniform() < probability; }
+
+        // High half of a 64 by 64 bit product (Lemire), the 128 bit type is a GCC and Clang extension
+        std::uint64_t below(const std::uint64_t bound) {
+            __extension__ using Wide = unsigned __int128;
+            return static_cast<std::uint64_t>((static_cast<Wide>(next()) * bound) >> 64);
+        }
+
+        double exponential(const double mean) { return -std::log1p(-uniform()) * mean; }
+
+        // Number of failures before the first success, with the given mean
+        std::uint64_t geometric(const double mean) {
+            if (mean <= 0) return 0;
+            return static_cast<std::uint64_t>(std::floor(std::log1p(-uniform()) / std::log1p(-1 / (mean + 1))));
+        }
+
+    private:
+        static std::uint64_t rotl(const std::uint64_t x, const int k) { return (x << k) | (x >> (64 - k)); }
+
+        std::uint64_t state[4]{};
+    };
+
+    // Buffers events and writes them in large blocks in either format
+    class EventWriter {
+    public:
+        EventWriter(std::FILE *file, const bool binary) : file(file), binary(binary) {
+            buffer.resize(bufferSize + maxFormattedEventLength);
+            if (binary) std::fwrite(binaryEventMagic, 1, sizeof(binaryEventMagic), file);
+        }
+
+        ~EventWriter() { flush(); }
+
+        void write(const OrderEvent &event) {
+            if (binary) {
+                const BinaryEvent record = toBinaryEvent(event);
+                std::memcpy(buffer.data() + used, &record, sizeof(record));
+                used += sizeof(record);
+            } else {
+                used += formatEvent(event, buffer.data() + used);
+            }
+            if (used >= bufferSize) flush();
+        }
+
+        void flush() {
+            std::fwrite(buffer.data(), 1, used, file);
+            used = 0;
+        }
+
+    private:
+        static constexpr std::size_t bufferSize = 1 << 20;
+
+        std::FILE *file;
+        bool binary;
+        std::vector<char> buffer;
+        std::size_t used = 0;
+    };
+
+    class Generator {
+    public:
+        Generator(const Options &options, EventWriter &writer)
+            : options(options), writer(writer), random(options.seed), midPrice(options.midPrice) {
+        }
+
+        void run() {
+            while (emitted < options.events) {
+                if (random.chance(options.sweepProbability)) {
+                    burst();
+                } else if (random.chance(cancelProbability())) {
+                    cancel();
+                } else {
+                    add();
+                }
+            }
+        }
+
+    private:
+        double cancelProbability() const {
+            const auto resting = static_cast<double>(book.getRestingOrders());
+            return resting == 0 ? 0 : resting / (resting + options.restingOrders);
+        }
+
+        void emit(const EventType type, const Order &order, const double meanGap) {
+            clock += random.exponential(meanGap);
+            writer.write(OrderEvent{type, static_cast<std::uint64_t>(clock), order});
+            ++emitted;
+            if (type == EventType::Cancel) {
+                book.removeOrder(order.orderId);
+                return;
+            }
+            // Whatever is left after matching rests and can be cancelled later
+            Order remainder = order;
+            trades.clear();
+            if (book.addOrder(remainder, trades).valid()) live.push_back(order.orderId);
+        }
+
+        Quantity lots() { return static_cast<Quantity>(100 * (1 + random.geometric(options.meanLots - 1))); }
+
+        void add() {
+            const Side side = random.chance(0.5) ? Side::Buy : Side::Sell;
+            const double meanGap = 1e9 / options.rate;
+
+            if (random.chance(options.aggressiveRatio)) {
+                const Price offset = 1 + random.geometric(1);
+                const Price price = side == Side::Buy ? midPrice + offset : midPrice - std::min(offset, midPrice - 1);
+                emit(EventType::Add, Order{nextOrderId++, lots(), price, side}, meanGap);
+                drift(side);
+                return;
+            }
+
+            const Price offset = 1 + random.geometric(options.touchOffset);
+            if (side == Side::Sell || offset < midPrice) {
+                Price price = side == Side::Buy ? midPrice - offset : midPrice + offset;
+                // The mid price drifts away from orders left behind, a passive order never crosses them
+                PriceLevel touch{};
+                if (book.getDepth(side == Side::Buy ? Side::Sell : Side::Buy, &touch, 1) == 1) {
+                    price = side == Side::Buy ? std::min(price, touch.price - 1) : std::max(price, touch.price + 1);
+                }
+                if (price > 0) emit(EventType::Add, Order{nextOrderId++, lots(), price, side}, meanGap);
+            }
+        }
+
+        // Orders filled since they rested are dropped from live as they are drawn, an add goes out instead when none
+        // is left
+        void cancel() {
+            while (!live.empty()) {
+                const std::size_t index = random.below(live.size());
+                const OrderId orderId = live[index];
+                live[index] = live.back();
+                live.pop_back();
+                if (book.findOrder(orderId).valid()) {
+                    emit(EventType::Cancel, Order{orderId, 0, 0, Side::Buy}, 1e9 / options.rate);
+                    return;
+                }
+            }
+            add();
+        }
+
+        // A quick succession of large orders on one side, each crossing several levels and moving the price
+        void burst() {
+            const Side side = random.chance(0.5) ? Side::Buy : Side::Sell;
+            const std::uint64_t length = 1 + random.geometric(options.burstLength - 1);
+            const double meanGap = 1e9 / options.rate / 100;
+
+            for (std::uint64_t i = 0; i < length && emitted < options.events; ++i) {
+                const Price levels = 1 + random.geometric(options.sweepLevels - 1);
+                const Price price = side == Side::Buy ? midPrice + levels : midPrice - std::min(levels, midPrice - 1);
+                const auto quantity = static_cast<Quantity>(levels * 2 * lots());
+                emit(EventType::Add, Order{nextOrderId++, quantity, price, side}, meanGap);
+                for (Price level = 0; level < levels / 2 + 1; ++level) drift(side);
+            }
+        }
+
+        // Aggressive flow pushes the mid price one tick in its direction
+        void drift(const Side side) {
+            if (side == Side::Buy) {
+                ++midPrice;
+            } else if (midPrice > 2) {
+                --midPrice;
+            }
+        }
+
+        const Options &options;
+        EventWriter &writer;
+        Random random;
+        Price midPrice;
+        OrderId nextOrderId = 1;
+        double clock = 0;
+        std::uint64_t emitted = 0;
+        // Orders that rested when they were added, some may have been filled since
+        std::vector<OrderId> live;
+        OrderBook book;
+        std::vector<TradeRequest> trades;
+    };
+
+    bool parseOptions(const int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument = argv[i];
+            if (argument == "--binary") {
+                options.binary = true;
+                continue;
+            }
+            if (i + 1 >= argc) return false;
+            const std::string value = argv[++i];
+            if (argument == "--output") {
+                options.outputPath = value;
+            } else if (argument == "--events") {
+                options.events = std::stoull(value);
+            } else if (argument == "--seed") {
+                options.seed = std::stoull(value);
+            } else if (argument == "--rate") {
+                options.rate = std::stod(value);
+            } else if (argument == "--resting-orders") {
+                options.restingOrders = std::stod(value);
+                if (options.restingOrders < 0) return false;
+            } else if (argument == "--aggressive-ratio") {
+                options.aggressiveRatio = std::stod(value);
+            } else if (argument == "--touch-offset") {
+                options.touchOffset = std::stod(value);
+            } else if (argument == "--sweep-probability") {
+                options.sweepProbability = std::stod(value);
+            } else if (argument == "--sweep-levels") {
+                options.sweepLevels = std::stod(value);
+            } else if (argument == "--burst-length") {
+                options.burstLength = std::stod(value);
+            } else if (argument == "--mid-price") {
+                if (!parsePrice(value, options.midPrice)) return false;
+            } else if (argument == "--mean-lots") {
+                options.meanLots = std::stod(value);
+            } else {
+                return false;
+            }
+        }
+        return !options.outputPath.empty() && options.rate > 0 && options.midPrice > 2 && options.meanLots >= 1 &&
+               options.sweepLevels >= 1 && options.burstLength >= 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: OrderGenerator --output <file> [--binary] [--events N] [--seed S] [--rate events/s] "
+                "[--resting-orders N] [--aggressive-ratio R] [--touch-offset ticks] [--sweep-probability P] "
+                "[--sweep-levels N] [--burst-length N] [--mid-price 100.00] [--mean-lots N]" << std::endl;
+        return 1;
+    }
+
+    std::FILE *file = options.outputPath == "-" ? stdout : std::fopen(options.outputPath.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "Cannot open " << options.outputPath << std::endl;
+        return 1;
+    }
+
+    {
+        EventWriter writer(file, options.binary);
+        Generator generator(options, writer);
+        generator.run();
+    }
+
+    if (file != stdout) std::fclose(file);
+    return 0;
+}
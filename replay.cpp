@@ -0,0 +1,513 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AllocationCounter.h"
+#include "ConflatedLevels.h"
+#include "OrderBook.h"
+#include "SharedMarketData.h"
+#include "functions.h"
+
+
+// Replays a recorded order stream through the book and reports throughput and per operation latencies.
+// Everything written to stdout depends only on the input, so two runs over the same file can be compared byte for
+// byte. Timings naturally differ between runs and are therefore written to stderr. With --replica the book publishes
+// its market by order records (see BookEvents.h) to a second thread that rebuilds the book from them. What that
+// ends up with depends on how many records the ring had to drop, so it is written to stderr as well. With
+// --conflate-every the level updates also go into a conflated view (see ConflatedLevels.h) whose one subscriber
+// catches up every N events. With --shared-memory the top of the book is published to a shared memory object (see
+// SharedMarketData.h) that a second thread reads back through the reader library; how many snapshots it sees and how
+// old they are is timing, so that goes to stderr too. The object must not exist yet, --replace-shared-memory unlinks
+// one a crashed run left behind. --top-of-book has the book store its best bid and offer behind a
+// seqlock (see OrderBookConfig::topOfBook) for a reader thread.
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Publish is the shared memory publishing after each event, timed on its own so the book's figures stay comparable
+    enum Operation { PassiveAdd, AggressiveAdd, Cancel, Publish, OperationCount };
+
+    const char *operationNames[OperationCount] = {"add.passive", "add.aggressive", "cancel", "publish.shm"};
+
+    struct Options {
+        std::string inputPath;
+        std::string tradesPath;
+        double pace = 0; // 0 replays as fast as possible, otherwise a multiplier of the recorded pace
+        OrderBookConfig capacity;
+        std::size_t replicaRing = 0; // Records the ring to the replica holds, 0 runs without a replica
+        std::size_t conflateEvery = 0; // Events between catch-ups of the conflated view, 0 runs without one
+        std::string sharedMemory; // Shared memory object to publish the top of the book to, empty for none
+        bool replaceSharedMemory = false; // Unlink an existing object of that name instead of failing
+        bool topOfBook = false; // Read the book's top of book from a second thread
+    };
+
+    // FNV-1a, used to fingerprint the trade stream and the final book
+    struct Checksum {
+        std::uint64_t value = 14695981039346656037ull;
+
+        void add(std::uint64_t word) {
+            for (int i = 0; i < 8; ++i) {
+                value ^= word & 0xff;
+                value *= 1099511628211ull;
+                word >>= 8;
+            }
+        }
+    };
+
+    void printUsage() {
+        std::cerr << "Usage: Replay <events-file> [--pace <multiplier>] [--trades <output-file>] [--max-orders N] "
+                "[--max-levels N] [--max-fills N] [--ladder-ticks N] [--lazy-cancels] "
+                "[--depth-index-ticks N] [--track-queue-positions] [--level-updates] [--replica ring-records] "
+                "[--conflate-every N] [--shared-memory name] [--replace-shared-memory] [--top-of-book]"
+                << std::endl;
+    }
+
+    bool parseOptions(const int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument = argv[i];
+            if (argument == "--pace" && i + 1 < argc) {
+                options.pace = std::stod(argv[++i]);
+                if (options.pace <= 0) return false;
+            } else if (argument == "--max-orders" && i + 1 < argc) {
+                options.capacity.maxOrders = std::stoul(argv[++i]);
+            } else if (argument == "--lazy-cancels") {
+                options.capacity.lazyCancels = true;
+            } else if (argument == "--track-queue-positions") {
+                options.capacity.trackQueuePositions = true;
+            } else if (argument == "--level-updates") {
+                options.capacity.publishLevelUpdates = true;
+            } else if (argument == "--conflate-every" && i + 1 < argc) {
+                options.conflateEvery = std::stoul(argv[++i]);
+                if (options.conflateEvery == 0) return false;
+                options.capacity.publishLevelUpdates = true;
+            } else if (argument == "--top-of-book") {
+                options.topOfBook = true;
+            } else if (argument == "--shared-memory" && i + 1 < argc) {
+                options.sharedMemory = argv[++i];
+                options.capacity.publishLevelUpdates = true;
+            } else if (argument == "--replace-shared-memory") {
+                options.replaceSharedMemory = true;
+            } else if (argument == "--replica" && i + 1 < argc) {
+                options.replicaRing = std::stoul(argv[++i]);
+                if (options.replicaRing == 0) return false;
+            } else if (argument == "--ladder-ticks" && i + 1 < argc) {
+                options.capacity.ladderTicks = std::stoul(argv[++i]);
+            } else if (argument == "--depth-index-ticks" && i + 1 < argc) {
+                options.capacity.depthIndexTicks = std::stoul(argv[++i]);
+            } else if (argument == "--max-levels" && i + 1 < argc) {
+                options.capacity.maxLevels = std::stoul(argv[++i]);
+            } else if (argument == "--max-fills" && i + 1 < argc) {
+                options.capacity.maxFillsPerCall = std::stoul(argv[++i]);
+            } else if (argument == "--trades" && i + 1 < argc) {
+                options.tradesPath = argv[++i];
+            } else if (options.inputPath.empty() && !argument.starts_with("--")) {
+                options.inputPath = argument;
+            } else {
+                return false;
+            }
+        }
+        return !options.inputPath.empty();
+    }
+
+    // Nearest-rank percentile of an already sorted sample
+    std::uint64_t percentile(const std::vector<std::uint64_t> &sorted, const double fraction) {
+        if (sorted.empty()) return 0;
+        const auto rank = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    void writeTrade(std::string &out, const TradeRequest &trade) {
+        char buffer[96];
+        const int length = std::snprintf(buffer, sizeof(buffer), "%lld,%lld,%llu,%u\n", trade.aggressorOrderId,
+                                         trade.restingOrderId, static_cast<unsigned long long>(trade.price),
+                                         trade.quantity);
+        out.append(buffer, static_cast<std::size_t>(length));
+    }
+
+    template<typename Levels>
+    void addLevels(Checksum &checksum, const Levels &levels) {
+        for (const auto &[price, orders]: levels) {
+            checksum.add(price);
+            for (const auto &order: orders) {
+                checksum.add(static_cast<std::uint64_t>(order.orderId));
+                checksum.add(order.quantity);
+            }
+        }
+    }
+
+    struct ReplicaResult {
+        std::uint64_t events = 0;
+        std::uint64_t gaps = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t bookChecksum = 0;
+        double elapsed = 0;
+    };
+
+    // Consumer thread: applies the records to a replica until the producer is done and the ring is empty
+    void runReplica(BookEventRing &ring, const OrderBookConfig &config, const std::atomic<bool> &producing,
+                    ReplicaResult &result) {
+        OrderBook replica(config);
+        std::uint64_t expectedSequence = 1;
+        Clock::duration busy{};
+        while (true) {
+            const std::span<const BookEvent> events = ring.peek();
+            if (events.empty()) {
+                if (!producing.load(std::memory_order_acquire) && ring.peek().empty()) break;
+                continue;
+            }
+            const Clock::time_point before = Clock::now();
+            for (const BookEvent &event: events) {
+                result.gaps += event.sequence != expectedSequence;
+                expectedSequence = event.sequence + 1;
+                result.rejected += !applyBookEvent(replica, event);
+            }
+            busy += Clock::now() - before;
+            result.events += events.size();
+            ring.pop(events.size());
+        }
+        result.elapsed = std::chrono::duration<double>(busy).count();
+
+        Checksum checksum;
+        addLevels(checksum, replica.getBids());
+        addLevels(checksum, replica.getAsks());
+        result.bookChecksum = checksum.value;
+    }
+
+    struct MarketDataResult {
+        std::uint64_t reads = 0;
+        std::uint64_t failedReads = 0; // Nothing published yet, or no consistent copy
+        std::uint64_t snapshots = 0; // Distinct snapshots seen
+        std::uint64_t inconsistent = 0; // Unsorted or crossed levels, which a torn copy would show
+        std::vector<std::uint64_t> ages; // Nanoseconds from publishing to the first read of each snapshot
+        std::string error;
+    };
+
+    struct TopOfBookResult {
+        std::uint64_t loads = 0;
+        std::uint64_t versions = 0; // Distinct versions seen
+        std::uint64_t inconsistent = 0; // Crossed, or a price without quantity, which a torn copy would show
+    };
+
+    // Reader thread: loads the top of book like a strategy thread would until the producer is done
+    void runTopOfBookReader(const SeqLock<TopOfBook> &top, const std::atomic<bool> &producing,
+                            TopOfBookResult &result) {
+        std::uint64_t lastVersion = 0;
+        while (producing.load(std::memory_order_acquire)) {
+            const TopOfBook loaded = top.load();
+            ++result.loads;
+            const std::uint64_t version = top.version();
+            if (version == lastVersion) continue;
+            lastVersion = version;
+            ++result.versions;
+            result.inconsistent += (loaded.bidPrice == 0) != (loaded.bidQuantity == 0) ||
+                    (loaded.askPrice == 0) != (loaded.askQuantity == 0) ||
+                    (loaded.bidPrice != 0 && loaded.askPrice != 0 && loaded.bidPrice >= loaded.askPrice);
+        }
+    }
+
+    bool samePriceLevel(const PriceLevel &a, const PriceLevel &b) {
+        return a.price == b.price && a.quantity == b.quantity && a.orderCount == b.orderCount;
+    }
+
+    bool consistent(const DepthSnapshot &snapshot) {
+        if (snapshot.bidLevels > sharedDepthLevels || snapshot.askLevels > sharedDepthLevels) return false;
+        for (std::uint32_t i = 1; i < snapshot.bidLevels; ++i) {
+            if (snapshot.bids[i].price >= snapshot.bids[i - 1].price) return false;
+        }
+        for (std::uint32_t i = 1; i < snapshot.askLevels; ++i) {
+            if (snapshot.asks[i].price <= snapshot.asks[i - 1].price) return false;
+        }
+        return snapshot.bidLevels == 0 || snapshot.askLevels == 0 || snapshot.bids[0].price < snapshot.asks[0].price;
+    }
+
+    // Reader thread: polls the shared memory object like a pricing process would until the producer is done
+    void runMarketDataReader(const std::string &name, const std::atomic<bool> &producing, MarketDataResult &result) {
+        const MarketDataReader reader(name);
+        if (!reader.available()) {
+            result.error = reader.error();
+            return;
+        }
+        DepthSnapshot snapshot{};
+        std::uint64_t lastSequence = UINT64_MAX;
+        while (producing.load(std::memory_order_acquire)) {
+            ++result.reads;
+            if (!reader.read(snapshot)) {
+                ++result.failedReads;
+                continue;
+            }
+            if (snapshot.sequence == lastSequence) continue;
+            lastSequence = snapshot.sequence;
+            ++result.snapshots;
+            result.ages.push_back(static_cast<std::uint64_t>(MarketDataReader::age(snapshot).count()));
+            result.inconsistent += !consistent(snapshot);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    if (!std::ifstream(options.inputPath).is_open()) {
+        std::cerr << "Cannot open " << options.inputPath << std::endl;
+        return 1;
+    }
+    const std::vector<OrderEvent> events = loadEvents(options.inputPath);
+
+    // Set up before any thread starts, so failing here returns with nothing left to join
+    std::unique_ptr<MarketDataPublisher> publisher;
+    std::atomic<bool> reading{true};
+    MarketDataResult marketDataResult;
+    std::thread readerThread;
+    if (!options.sharedMemory.empty()) {
+        publisher = std::make_unique<MarketDataPublisher>(options.sharedMemory, options.replaceSharedMemory);
+        if (!publisher->available()) {
+            std::cerr << publisher->error() << std::endl;
+            if (!options.replaceSharedMemory) {
+                std::cerr << "--replace-shared-memory unlinks an object a crashed run left behind" << std::endl;
+            }
+            return 1;
+        }
+        // The reader's samples must not show up as allocations of the book
+        marketDataResult.ages.reserve(events.size());
+        readerThread = std::thread(runMarketDataReader, options.sharedMemory, std::cref(reading),
+                                   std::ref(marketDataResult));
+    }
+
+    std::unique_ptr<BookEventRing> replicaRing;
+    std::atomic<bool> producing{true};
+    ReplicaResult replicaResult;
+    std::thread replicaThread;
+    if (options.replicaRing != 0) {
+        replicaRing = std::make_unique<BookEventRing>(options.replicaRing);
+        replicaThread = std::thread(runReplica, std::ref(*replicaRing), options.capacity, std::cref(producing),
+                                    std::ref(replicaResult));
+        options.capacity.eventRing = replicaRing.get();
+    }
+
+    SeqLock<TopOfBook> topOfBook;
+    TopOfBookResult topOfBookResult;
+    std::thread topOfBookThread;
+    if (options.topOfBook) {
+        options.capacity.topOfBook = &topOfBook;
+        topOfBookThread = std::thread(runTopOfBookReader, std::cref(topOfBook), std::cref(reading),
+                                      std::ref(topOfBookResult));
+    }
+
+    OrderBook orderBook(options.capacity);
+    std::vector<TradeRequest> trades;
+    trades.reserve(options.capacity.maxFillsPerCall);
+    std::vector<std::uint64_t> latencies[OperationCount];
+    for (auto &samples: latencies) samples.reserve(events.size());
+
+    std::string tradeLog;
+    Checksum tradeChecksum;
+    std::uint64_t tradeCount = 0;
+    std::uint64_t tradedQuantity = 0;
+    std::uint64_t rejectedCancels = 0;
+    std::uint64_t allocations = 0;
+    Checksum levelUpdateChecksum;
+    std::uint64_t levelUpdateCount = 0;
+    ConflatedLevels conflated;
+    const std::size_t subscriber = conflated.subscribe();
+    Checksum conflatedChecksum;
+    std::uint64_t conflatedCount = 0;
+    const auto catchUp = [&] {
+        conflatedCount += conflated.catchUp(subscriber, [&](const LevelUpdate &update) {
+            conflatedChecksum.add(update.price << 1 | static_cast<std::uint64_t>(update.side));
+            conflatedChecksum.add(update.quantity);
+            conflatedChecksum.add(update.orderCount);
+        });
+    };
+
+    const bool paced = options.pace > 0 && !events.empty() && events.back().timestamp > 0;
+    const std::uint64_t firstTimestamp = events.empty() ? 0 : events.front().timestamp;
+    // Latest timestamp so far, an event stamped earlier than one before it goes out right away
+    std::uint64_t pacedTimestamp = firstTimestamp;
+    const Clock::time_point start = Clock::now();
+
+    std::uint64_t eventIndex = 0;
+    for (const auto &event: events) {
+        if (paced) {
+            pacedTimestamp = std::max(pacedTimestamp, event.timestamp);
+            const auto offset = std::chrono::nanoseconds(static_cast<std::int64_t>(
+                static_cast<double>(pacedTimestamp - firstTimestamp) / options.pace));
+            while (Clock::now() - start < offset) {
+            }
+        }
+
+        Operation operation;
+        trades.clear();
+        const std::uint64_t allocationsBefore = allocationCount();
+        const Clock::time_point before = Clock::now();
+        if (event.type == EventType::Add) {
+            Order order = event.order;
+            orderBook.addOrder(order, trades);
+            operation = trades.empty() ? PassiveAdd : AggressiveAdd;
+        } else {
+            if (!orderBook.removeOrder(event.order.orderId)) ++rejectedCancels;
+            operation = Cancel;
+        }
+        const Clock::time_point after = Clock::now();
+        allocations += allocationCount() - allocationsBefore;
+        latencies[operation].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+        if (publisher != nullptr) {
+            publisher->publishChanges(orderBook);
+            latencies[Publish].push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - after).count());
+        }
+
+        for (const auto &trade: trades) {
+            tradeChecksum.add(static_cast<std::uint64_t>(trade.aggressorOrderId));
+            tradeChecksum.add(static_cast<std::uint64_t>(trade.restingOrderId));
+            tradeChecksum.add(trade.price);
+            tradeChecksum.add(trade.quantity);
+            tradedQuantity += trade.quantity;
+            if (!options.tradesPath.empty()) writeTrade(tradeLog, trade);
+        }
+        tradeCount += trades.size();
+
+        for (const LevelUpdate &update: orderBook.getLevelUpdates()) {
+            levelUpdateChecksum.add(static_cast<std::uint64_t>(update.side));
+            levelUpdateChecksum.add(update.price);
+            levelUpdateChecksum.add(update.quantity);
+            levelUpdateChecksum.add(update.orderCount);
+        }
+        levelUpdateCount += orderBook.getLevelUpdates().size();
+
+        if (options.conflateEvery != 0) {
+            conflated.apply(orderBook.getLevelUpdates());
+            if (++eventIndex % options.conflateEvery == 0) catchUp();
+        }
+    }
+    // The subscriber ends up with the final levels however the events divide up
+    if (options.conflateEvery != 0) catchUp();
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    reading.store(false, std::memory_order_release);
+    bool topOfBookMatches = true;
+    if (topOfBookThread.joinable()) {
+        topOfBookThread.join();
+        PriceLevel best{};
+        const TopOfBook loaded = topOfBook.load();
+        topOfBookMatches = orderBook.getDepth(Side::Buy, &best, 1) == 1
+                               ? loaded.bidPrice == best.price && loaded.bidQuantity == best.quantity
+                               : loaded.bidPrice == 0 && loaded.bidQuantity == 0;
+        topOfBookMatches = topOfBookMatches && (orderBook.getDepth(Side::Sell, &best, 1) == 1
+                                                    ? loaded.askPrice == best.price &&
+                                                      loaded.askQuantity == best.quantity
+                                                    : loaded.askPrice == 0 && loaded.askQuantity == 0);
+    }
+    bool sharedTopMatches = true;
+    if (readerThread.joinable()) {
+        readerThread.join();
+        // What a reader sees once the publisher is done has to be the final book
+        DepthSnapshot last{};
+        PriceLevel levels[sharedDepthLevels];
+        const MarketDataReader reader(options.sharedMemory);
+        sharedTopMatches = reader.read(last) &&
+                           last.bidLevels == orderBook.getDepth(Side::Buy, levels, sharedDepthLevels) &&
+                           std::equal(levels, levels + last.bidLevels, last.bids, samePriceLevel) &&
+                           last.askLevels == orderBook.getDepth(Side::Sell, levels, sharedDepthLevels) &&
+                           std::equal(levels, levels + last.askLevels, last.asks, samePriceLevel);
+    }
+    if (replicaThread.joinable()) {
+        producing.store(false, std::memory_order_release);
+        replicaThread.join();
+    }
+
+    if (!options.tradesPath.empty()) {
+        std::ofstream tradesFile(options.tradesPath, std::ios::binary);
+        tradesFile.write(tradeLog.data(), static_cast<std::streamsize>(tradeLog.size()));
+    }
+
+    Checksum bookChecksum;
+    addLevels(bookChecksum, orderBook.getBids());
+    addLevels(bookChecksum, orderBook.getAsks());
+
+    const std::uint64_t cancels = latencies[Cancel].size();
+    std::printf("events: %zu\n", events.size());
+    std::printf("adds: %llu (rejected %llu)\n", static_cast<unsigned long long>(events.size() - cancels),
+                static_cast<unsigned long long>(orderBook.getRejectedOrders()));
+    std::printf("cancels: %llu (rejected %llu)\n", static_cast<unsigned long long>(cancels),
+                static_cast<unsigned long long>(rejectedCancels));
+    std::printf("trades: %llu\n", static_cast<unsigned long long>(tradeCount));
+    std::printf("traded quantity: %llu\n", static_cast<unsigned long long>(tradedQuantity));
+    std::printf("trade checksum: %016llx\n", static_cast<unsigned long long>(tradeChecksum.value));
+    std::printf("book checksum: %016llx\n", static_cast<unsigned long long>(bookChecksum.value));
+    if (options.capacity.publishLevelUpdates) {
+        std::printf("level updates: %llu\n", static_cast<unsigned long long>(levelUpdateCount));
+        std::printf("level update checksum: %016llx\n", static_cast<unsigned long long>(levelUpdateChecksum.value));
+    }
+    if (options.conflateEvery != 0) {
+        // The catch-ups report levels in slot order, the checksum adds them up in that order
+        std::printf("conflated updates: %llu\n", static_cast<unsigned long long>(conflatedCount));
+        std::printf("conflated update checksum: %016llx\n", static_cast<unsigned long long>(conflatedChecksum.value));
+    }
+
+    std::fprintf(stderr, "elapsed: %.6f s%s\n", elapsed, paced ? " (paced)" : "");
+    std::fprintf(stderr, "events/sec: %.0f\n", static_cast<double>(events.size()) / elapsed);
+    std::fprintf(stderr, "trades/sec: %.0f\n", static_cast<double>(tradeCount) / elapsed);
+    std::fprintf(stderr, "allocations inside the book: %llu\n", static_cast<unsigned long long>(allocations));
+    if (publisher != nullptr) {
+        auto &ages = marketDataResult.ages;
+        std::sort(ages.begin(), ages.end());
+        std::fprintf(stderr, "shared memory: %llu snapshots published, reader saw %llu in %llu reads (%llu failed, "
+                     "%llu inconsistent), age p50 %llu ns p99 %llu ns, final top %s%s%s\n",
+                     static_cast<unsigned long long>(publisher->published()),
+                     static_cast<unsigned long long>(marketDataResult.snapshots),
+                     static_cast<unsigned long long>(marketDataResult.reads),
+                     static_cast<unsigned long long>(marketDataResult.failedReads),
+                     static_cast<unsigned long long>(marketDataResult.inconsistent),
+                     static_cast<unsigned long long>(percentile(ages, 0.5)),
+                     static_cast<unsigned long long>(percentile(ages, 0.99)),
+                     sharedTopMatches ? "matches" : "differs",
+                     marketDataResult.error.empty() ? "" : ", reader: ", marketDataResult.error.c_str());
+    }
+    if (options.topOfBook) {
+        std::fprintf(stderr, "top of book: %llu versions stored, reader saw %llu in %llu loads (%llu inconsistent), "
+                     "final %s\n", static_cast<unsigned long long>(topOfBook.version()),
+                     static_cast<unsigned long long>(topOfBookResult.versions),
+                     static_cast<unsigned long long>(topOfBookResult.loads),
+                     static_cast<unsigned long long>(topOfBookResult.inconsistent),
+                     topOfBookMatches ? "matches" : "differs");
+    }
+    if (replicaRing != nullptr) {
+        std::fprintf(stderr, "replica: %llu records (%llu dropped, %llu gaps, %llu rejected) in %.6f s busy, book %s\n",
+                     static_cast<unsigned long long>(replicaResult.events),
+                     static_cast<unsigned long long>(orderBook.getDroppedEvents()),
+                     static_cast<unsigned long long>(replicaResult.gaps),
+                     static_cast<unsigned long long>(replicaResult.rejected), replicaResult.elapsed,
+                     replicaResult.bookChecksum == bookChecksum.value ? "matches" : "differs");
+    }
+    std::fprintf(stderr, "%-16s %12s %10s %10s %10s %10s %10s\n", "latency (ns)", "count", "p50", "p90", "p99",
+                 "p99.9", "max");
+    for (int operation = 0; operation < OperationCount; ++operation) {
+        auto &samples = latencies[operation];
+        if (operation == Publish && samples.empty()) continue;
+        std::sort(samples.begin(), samples.end());
+        std::fprintf(stderr, "%-16s %12zu %10llu %10llu %10llu %10llu %10llu\n", operationNames[operation],
+                     samples.size(),
+                     static_cast<unsigned long long>(percentile(samples, 0.5)),
+                     static_cast<unsigned long long>(percentile(samples, 0.9)),
+                     static_cast<unsigned long long>(percentile(samples, 0.99)),
+                     static_cast<unsigned long long>(percentile(samples, 0.999)),
+                     static_cast<unsigned long long>(samples.empty() ? 0 : samples.back()));
+    }
+
+#ifdef ORDERBOOK_LATENCY_STATS
+    std::cerr << "latency recorded inside OrderBook" << std::endl;
+    orderBook.dumpLatencyStats(std::cerr);
+#endif
+
+    return 0;
+}